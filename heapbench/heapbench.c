@@ -0,0 +1,46 @@
+#include "syscalls/syscalls.h"
+#include "syscalls/vdso.h"
+#include "std/string.h"
+
+#define HEAP_BENCH_ITERATIONS 20000
+#define HEAP_BENCH_LIVE 64
+
+static void report(const char *name, uint64_t value, const char *unit){
+    printf("[bench] %s %i %s", (uintptr_t)name, value, (uintptr_t)unit);
+}
+
+typedef uintptr_t (*alloc_fn)(size_t size);
+typedef void (*free_fn)(void *ptr, size_t size);
+
+//Alloc/free pairs across the size classes with a working set of live blocks, the same mix as the kernel's alloc bench
+static uint64_t churn(alloc_fn alloc, free_fn release){
+    uint32_t sizes[] = { 24, 100, 200, 700, 1500 };
+    uintptr_t live[HEAP_BENCH_LIVE] = {0};
+    uint64_t start = vdso_time_ns();
+    for (int i = 0; i < HEAP_BENCH_ITERATIONS; i++){
+        int slot = i % HEAP_BENCH_LIVE;
+        if (live[slot]) release((void*)live[slot], sizes[(i - HEAP_BENCH_LIVE) % 5]);
+        live[slot] = alloc(sizes[i % 5]);
+    }
+    uint64_t elapsed = vdso_time_ns() - start;
+    for (int i = HEAP_BENCH_ITERATIONS - HEAP_BENCH_LIVE; i < HEAP_BENCH_ITERATIONS; i++)
+        release((void*)live[i % HEAP_BENCH_LIVE], sizes[i % 5]);
+    return elapsed / HEAP_BENCH_ITERATIONS;
+}
+
+//Every string_format allocates its result, which used to be a trap per call
+static uint64_t format_strings(){
+    uint64_t start = vdso_time_ns();
+    for (int i = 0; i < HEAP_BENCH_ITERATIONS; i++){
+        string s = string_format("frame %i at %x", i, (uintptr_t)i * 16);
+        free(s.data, s.mem_length);
+    }
+    return (vdso_time_ns() - start) / HEAP_BENCH_ITERATIONS;
+}
+
+void proc_func(){
+    report("heap.churn_user", churn(malloc, free), "ns");
+    report("heap.churn_syscall", churn(malloc_syscall, free_syscall), "ns");
+    report("heap.string_format", format_strings(), "ns");
+    halt();
+}
@@ -0,0 +1,144 @@
+#include "shim.h"
+#include "syscalls/syscalls.h"
+#include "std/memfunctions.h"
+#include "std/string.h"
+#include "std/string_builder.h"
+#include "net/network_types.h"
+#include "ui/draw/draw.h"
+
+//Same "[bench] <name> <value> <unit>" lines as the in-kernel benchmarks, so both logs parse the same way
+
+#define MEM_BENCH_MAX 0x100000
+#define MEM_BENCH_BYTES 0x4000000
+#define FORMAT_BENCH_ITERATIONS 200000
+#define CHECKSUM_BENCH_ITERATIONS 200000
+#define CHECKSUM_BENCH_BYTES 1500
+#define FB_WIDTH 1920
+#define FB_HEIGHT 1080
+#define FB_BENCH_ITERATIONS 50
+#define ZERO_BENCH_PAGES 256
+#define ZERO_BENCH_ITERATIONS 200000
+
+static volatile uint64_t sink;
+
+static void bench_memcpy(){
+    uint8_t *a = map_pages(MEM_BENCH_MAX + 64);
+    uint8_t *b = map_pages(MEM_BENCH_MAX + 64);
+    memset(b, 0x5A, MEM_BENCH_MAX + 64);
+    for (uint64_t size = 16; size <= MEM_BENCH_MAX; size <<= 2){
+        uint64_t rounds = MEM_BENCH_BYTES / size;
+        uint64_t start = host_time_ns();
+        for (uint64_t i = 0; i < rounds; i++){
+            memcpy(a, b, size);
+            asm volatile ("" ::: "memory");
+        }
+        uint64_t ns = host_time_ns() - start;
+        printf("[bench] host.memcpy.%i %i MB/s", size, ns ? (rounds * size * 1000) / ns : 0);
+
+        start = host_time_ns();
+        for (uint64_t i = 0; i < rounds; i++){
+            memcpy(a + 3, b + 1, size);
+            asm volatile ("" ::: "memory");
+        }
+        ns = host_time_ns() - start;
+        printf("[bench] host.memcpy_unaligned.%i %i MB/s", size, ns ? (rounds * size * 1000) / ns : 0);
+    }
+    unmap_pages(a, MEM_BENCH_MAX + 64);
+    unmap_pages(b, MEM_BENCH_MAX + 64);
+}
+
+static void bench_string_format(){
+    uint64_t start = host_time_ns();
+    for (int i = 0; i < FORMAT_BENCH_ITERATIONS; i++){
+        string s = string_format("%s %i %x %c", (uintptr_t)"value", i, (uint64_t)i * 0x1F, 'z');
+        sink += s.length;
+        free(s.data, s.mem_length);
+    }
+    uint64_t ns = host_time_ns() - start;
+    printf("[bench] host.string_format %i ns", ns / FORMAT_BENCH_ITERATIONS);
+
+    //The same strings from an arena that's reset every 100, like a frame's worth of labels
+    string_arena arena = {0};
+    start = host_time_ns();
+    for (int i = 0; i < FORMAT_BENCH_ITERATIONS; i++){
+        string s = string_format_arena(&arena, "%s %i %x %c", (uintptr_t)"value", i, (uint64_t)i * 0x1F, 'z');
+        sink += s.length;
+        if (i % 100 == 99) arena_reset(&arena);
+    }
+    ns = host_time_ns() - start;
+    arena_release(&arena);
+    printf("[bench] host.string_format_arena %i ns", ns / FORMAT_BENCH_ITERATIONS);
+}
+
+static void bench_checksum(){
+    uint16_t packet[CHECKSUM_BENCH_BYTES / 2];
+    for (int i = 0; i < CHECKSUM_BENCH_BYTES / 2; i++) packet[i] = i * 0x9E37;
+    uint64_t start = host_time_ns();
+    for (int i = 0; i < CHECKSUM_BENCH_ITERATIONS; i++){
+        sink += checksum16(packet, CHECKSUM_BENCH_BYTES / 2);
+        asm volatile ("" ::: "memory");
+    }
+    uint64_t ns = host_time_ns() - start;
+    printf("[bench] host.checksum16_1500 %i ns", ns / CHECKSUM_BENCH_ITERATIONS);
+}
+
+//What kalloc used to spend zeroing a block on allocation and again on kfree, with the memset the kernel uses.
+//The blocks rotate through 1MB, like a heap that's reused rather than one hot block
+static void bench_zeroing(){
+    uint8_t *pages = map_pages(ZERO_BENCH_PAGES * 0x1000);
+    for (uint64_t size = 0x800; size <= 0x1000; size <<= 1){
+        uint64_t start = host_time_ns();
+        for (int i = 0; i < ZERO_BENCH_ITERATIONS; i++){
+            memset(pages + (i % ZERO_BENCH_PAGES) * 0x1000, 0, size);
+            asm volatile ("" ::: "memory");
+        }
+        uint64_t ns = host_time_ns() - start;
+        printf("[bench] host.zero.memset_%i %i ns", size, ns / ZERO_BENCH_ITERATIONS);
+    }
+    unmap_pages(pages, ZERO_BENCH_PAGES * 0x1000);
+}
+
+//Drawing into a plain buffer the size of a 1080p framebuffer
+static void bench_fill_rect(){
+    size_t size = FB_WIDTH * FB_HEIGHT * 4;
+    uint32_t *fb = map_pages(size);
+    fb_set_stride(FB_WIDTH * 4);
+    fb_set_bounds(FB_WIDTH, FB_HEIGHT);
+
+    uint64_t start = host_time_ns();
+    for (int i = 0; i < FB_BENCH_ITERATIONS; i++){
+        fb_clear(fb, 0xFF000000 | i);
+        asm volatile ("" ::: "memory");
+    }
+    uint64_t ns = host_time_ns() - start;
+    printf("[bench] host.fb_clear_1080p %i us", ns / FB_BENCH_ITERATIONS / 1000);
+
+    start = host_time_ns();
+    for (int i = 0; i < FB_BENCH_ITERATIONS; i++){
+        fb_fill_rect(fb, 0, 0, FB_WIDTH, FB_HEIGHT, 0xFF000000 | i);
+        asm volatile ("" ::: "memory");
+    }
+    ns = host_time_ns() - start;
+    printf("[bench] host.fb_fill_rect_1080p %i us", ns / FB_BENCH_ITERATIONS / 1000);
+
+    start = host_time_ns();
+    for (int i = 0; i < FB_BENCH_ITERATIONS * 100; i++){
+        fb_fill_rect(fb, i % 1000, i % 500, 200, 100, 0xFF00FF00);
+        asm volatile ("" ::: "memory");
+    }
+    ns = host_time_ns() - start;
+    printf("[bench] host.fb_fill_rect_200x100 %i ns", ns / (FB_BENCH_ITERATIONS * 100));
+
+    unmap_pages(fb, size);
+}
+
+int main(){
+    printl("[bench] start");
+    bench_memcpy();
+    bench_string_format();
+    bench_checksum();
+    bench_zeroing();
+    bench_fill_rect();
+    printl("[bench] end");
+    return 0;
+}
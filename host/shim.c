@@ -0,0 +1,98 @@
+#include "shim.h"
+#include "syscalls/syscalls.h"
+
+//Linux system calls for the syscalls libshared expects from the OS. Only what the host build needs is here
+
+#if defined(__x86_64__)
+#define SYS_WRITE 1
+#define SYS_MMAP 9
+#define SYS_MUNMAP 11
+#define SYS_CLOCK_GETTIME 228
+#define SYS_EXIT_GROUP 231
+
+static long linux_syscall(long n, long a0, long a1, long a2, long a3, long a4, long a5){
+    register long r10 asm("r10") = a3;
+    register long r8 asm("r8") = a4;
+    register long r9 asm("r9") = a5;
+    long ret;
+    asm volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a0), "S"(a1), "d"(a2), "r"(r10), "r"(r8), "r"(r9) : "rcx", "r11", "memory");
+    return ret;
+}
+
+asm(".global _start\n"
+    "_start:\n"
+    "    xor %rbp, %rbp\n"
+    "    and $-16, %rsp\n"
+    "    call host_start\n");
+
+#elif defined(__aarch64__)
+#define SYS_WRITE 64
+#define SYS_MMAP 222
+#define SYS_MUNMAP 215
+#define SYS_CLOCK_GETTIME 113
+#define SYS_EXIT_GROUP 94
+
+static long linux_syscall(long n, long a0, long a1, long a2, long a3, long a4, long a5){
+    register long x8 asm("x8") = n;
+    register long x0 asm("x0") = a0;
+    register long x1 asm("x1") = a1;
+    register long x2 asm("x2") = a2;
+    register long x3 asm("x3") = a3;
+    register long x4 asm("x4") = a4;
+    register long x5 asm("x5") = a5;
+    asm volatile ("svc #0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2), "r"(x3), "r"(x4), "r"(x5) : "memory");
+    return x0;
+}
+
+asm(".global _start\n"
+    "_start:\n"
+    "    mov x29, #0\n"
+    "    mov x30, #0\n"
+    "    bl host_start\n");
+
+#else
+#error "The host build supports x86-64 and aarch64 Linux"
+#endif
+
+#define PROT_READ_WRITE 3
+#define MAP_PRIVATE_ANONYMOUS 0x22
+#define CLOCK_MONOTONIC 1
+
+typedef struct {
+    int64_t sec;
+    int64_t nsec;
+} linux_timespec;
+
+int main();
+
+__attribute__((noreturn, used)) void host_start(){
+    int code = main();
+    linux_syscall(SYS_EXIT_GROUP, code, 0, 0, 0, 0, 0);
+    __builtin_unreachable();
+}
+
+uint64_t host_time_ns(){
+    linux_timespec ts;
+    linux_syscall(SYS_CLOCK_GETTIME, CLOCK_MONOTONIC, (long)&ts, 0, 0, 0, 0);
+    return ts.sec * 1000000000ULL + ts.nsec;
+}
+
+uint64_t get_time(){
+    return host_time_ns() / 1000000;
+}
+
+void printl(const char *str){
+    linux_syscall(SYS_WRITE, 1, (long)str, strlen(str, 0), 0, 0, 0);
+    linux_syscall(SYS_WRITE, 1, (long)"\n", 1, 0, 0, 0);
+}
+
+//Anonymous mappings are zeroed and only committed when touched, like map_pages on the OS
+void* map_pages(size_t size){
+    long addr = linux_syscall(SYS_MMAP, 0, size, PROT_READ_WRITE, MAP_PRIVATE_ANONYMOUS, -1, 0);
+    if (addr < 0 && addr > -4096) return 0;
+    return (void*)addr;
+}
+
+void unmap_pages(void *ptr, size_t size){
+    linux_syscall(SYS_MUNMAP, (long)ptr, size, 0, 0, 0, 0);
+}
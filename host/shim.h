@@ -0,0 +1,14 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+//Monotonic clock of the host, for timing
+uint64_t host_time_ns();
+
+#ifdef __cplusplus
+}
+#endif
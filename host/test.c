@@ -0,0 +1,415 @@
+#include "shim.h"
+#include "syscalls/syscalls.h"
+#include "std/memfunctions.h"
+#include "std/string.h"
+#include "std/string_builder.h"
+#include "data_struct/linked_list.h"
+#include "data_struct/doubly_linked_list.h"
+#include "data_struct/chunked_list.h"
+#include "data_struct/queue.h"
+#include "data_struct/ring_buffer.h"
+#include "net/network_types.h"
+#include "ui/draw/draw.h"
+
+//Assertions over the portable parts of libshared. Failures print "[test] FAIL <file>:<line> <condition>",
+//and the exit code is the number of them
+
+static int checks;
+static int failures;
+
+#define CHECK(cond) \
+    ({ \
+        checks++; \
+        if (!(cond)){ \
+            failures++; \
+            printf("[test] FAIL %s:%i %s", (uintptr_t)__FILE__, __LINE__, (uintptr_t)#cond); \
+        } \
+    })
+
+//Compares a heap string with what it should hold and frees it
+#define CHECK_STRING(s, expected) \
+    ({ \
+        string _s = (s); \
+        CHECK(_s.data && strcmp(_s.data, expected, false) == 0); \
+        if (_s.data && strcmp(_s.data, expected, false) != 0) \
+            printf("[test]   got \"%s\", expected \"%s\"", (uintptr_t)_s.data, (uintptr_t)(expected)); \
+        if (_s.mem_length) free(_s.data, _s.mem_length); \
+    })
+
+static void test_string(){
+    CHECK(strlen("hello", 0) == 5);
+    CHECK(strlen("hello", 3) == 3);
+    CHECK(strlen(NULL, 0) == 0);
+    CHECK(strcmp("abc", "abc", false) == 0);
+    CHECK(strcmp("abc", "abd", false) < 0);
+    CHECK(strcmp("ABC", "abc", true) == 0);
+    CHECK(strcmp("ABC", "abc", false) != 0);
+    CHECK(strindex("hello world", "world") == 6);
+    CHECK(strindex("hello", "xyz") == -1);
+    CHECK(strcont("hello world", "lo w"));
+    CHECK(!strcont("hello", "world"));
+    CHECK(strstart("prefix_rest", "prefix", false) == 6);
+    CHECK(parse_hex_u64("1aF", 3) == 0x1AF);
+    CHECK(parse_hex_u64("ffz0", 4) == 0xFF);
+    CHECK(tolower('Q') == 'q' && tolower('7') == '7');
+
+    CHECK_STRING(string_l("literal"), "literal");
+    CHECK_STRING(string_ca_max("truncated", 5), "trunc");
+    CHECK_STRING(string_c('x'), "x");
+    CHECK_STRING(string_tail("abcdef", 3), "def");
+    CHECK_STRING(string_tail("ab", 3), "ab");
+    CHECK_STRING(string_repeat('-', 4), "----");
+    CHECK_STRING(string_from_hex(0), "0x0");
+    CHECK_STRING(string_from_hex(0xBEEF), "0xBEEF");
+
+    string a = string_l("same");
+    string b = string_l("same");
+    CHECK(string_equals(a, b));
+    free(a.data, a.mem_length);
+    free(b.data, b.mem_length);
+}
+
+static void test_string_format(){
+    CHECK_STRING(string_format("[%5i|%-5i|%05i|%.3i|%i]", 42, 42, -42, 7, -1), "[   42|42   |-0042|007|-1]");
+    CHECK_STRING(string_format("%u", UINT64_MAX), "18446744073709551615");
+    CHECK_STRING(string_format("[%s|%8s|%-8s|%.2s|%c|%%]", (uintptr_t)"abc", (uintptr_t)"abc", (uintptr_t)"abc", (uintptr_t)"abc", 'z'),
+                 "[abc|     abc|abc     |ab|z|%]");
+    CHECK_STRING(string_format("[%f|%.2f|%8.3f|%08.2f|%f]", 3.14159, 2.5, -1.5, -3.14159, 0.1),
+                 "[3.141590|2.50|  -1.500|-0003.14|0.100000]");
+    CHECK_STRING(string_format("[%*i|%.*f]", 6, 12, 3, 1.23456), "[    12|1.235]");
+
+    //Whole parts past 64 bits keep their magnitude, with 15 significant digits and zeros after them
+    CHECK_STRING(string_format("%.0f", 18446744073709551616.0), "18446744073709600000");
+    CHECK_STRING(string_format("%.3f", 123456789012345678901234567890.0), "123456789012346000000000000000.000");
+    CHECK_STRING(string_format("%.1f", -1e20), "-100000000000000000000.0");
+    string huge = string_format("%.2f", 1.5e300);
+    bool zeros = huge.length == 304 && huge.data[0] == '1' && huge.data[1] == '5' && huge.data[301] == '.';
+    for (int i = 2; i < 301; i++) zeros &= huge.data[i] == '0';
+    CHECK(zeros && strcmp(huge.data + 301, ".00", false) == 0);
+    free(huge.data, huge.mem_length);
+    CHECK_STRING(string_format("%.0f|%f", 1.0 / 0.0, -1.0 / 0.0), "inf|-inf");
+
+    //Nothing caps string_format, unlike the fixed buffer
+    char big[300];
+    for (int i = 0; i < 299; i++) big[i] = 'a' + (i % 26);
+    big[299] = 0;
+    string s = string_format("%s|%s", (uintptr_t)big, (uintptr_t)big);
+    CHECK(s.length == 599 && s.data[299] == '|' && s.data[599] == 0);
+    free(s.data, s.mem_length);
+
+    va_list none = {0};
+    char buf[256];
+    CHECK(string_format_va_buf("plain", buf, none) == 5 && strcmp(buf, "plain", false) == 0);
+}
+
+static void test_string_builder(){
+    string_builder sb;
+    sb_init(&sb, NULL);
+    for (int i = 0; i < 1000; i++)
+        sb_format(&sb, "%i,", i);
+    CHECK(sb.length == 3890);
+    CHECK(sb.data[sb.length] == 0);
+    string s = sb_to_string(&sb);
+    CHECK(s.length == 3890 && s.mem_length > s.length);
+    CHECK(strcmp(s.data + s.length - 8, "998,999,", false) == 0);
+    CHECK(sb.length == 0);
+    free(s.data, s.mem_length);
+
+    //Fixed builders stop at their buffer and stay terminated
+    char buf[8];
+    sb_init_buf(&sb, buf, sizeof(buf), true);
+    sb_append_cstr(&sb, "0123456789");
+    CHECK(sb.length == 7 && strcmp(buf, "0123456", false) == 0);
+    CHECK(!sb_reserve(&sb, 1));
+
+    //A zero sized buffer isn't written to, not even for the terminator
+    buf[0] = 'z';
+    sb_init_buf(&sb, buf, 0, true);
+    sb_append_cstr(&sb, "dropped");
+    CHECK(sb.length == 0 && sb.data[0] == 0 && buf[0] == 'z');
+    sb_init_buf(&sb, buf, 0, false);
+    sb_append_cstr(&sb, "kept");
+    CHECK(sb.length == 4 && strcmp(sb.data, "kept", false) == 0 && buf[0] == 'z');
+    sb_free(&sb);
+
+    //Non-fixed ones move to the heap once the buffer is full
+    sb_init_buf(&sb, buf, sizeof(buf), false);
+    sb_append_repeat(&sb, 'x', 20);
+    sb_append_c(&sb, '!');
+    CHECK(sb.length == 21 && sb.data != buf && sb.data[20] == '!');
+    sb_free(&sb);
+
+    string_arena arena = {0};
+    string first = string_format_arena(&arena, "frame %i", 1);
+    CHECK(first.mem_length == 0 && strcmp(first.data, "frame 1", false) == 0);
+    for (int i = 0; i < 500; i++)
+        string_format_arena(&arena, "label %i of a frame's worth", i);
+    CHECK(arena.chunks && arena.chunks->next);
+    arena_reset(&arena);
+    CHECK(arena.chunks && !arena.chunks->next);
+    string again = string_format_arena(&arena, "frame %i", 2);
+    CHECK(strcmp(again.data, "frame 2", false) == 0);
+    arena_release(&arena);
+    CHECK(!arena.chunks);
+}
+
+static int compare_ints(void *a, void *b){
+    return (int)((intptr_t)a - (intptr_t)b);
+}
+
+static void test_linked_list(){
+    clinkedlist_t *list = clinkedlist_create();
+    for (intptr_t i = 1; i <= 3; i++)
+        clinkedlist_push_front(list, (void*)i);
+    CHECK(clinkedlist_length(list) == 3);
+    CHECK((intptr_t)list->head->data == 3 && (intptr_t)list->tail->data == 1);
+
+    clinkedlist_node_t *two = clinkedlist_find(list, (void*)2, compare_ints);
+    CHECK(two && (intptr_t)two->data == 2);
+    clinkedlist_insert_after(list, two, (void*)5);
+    CHECK((intptr_t)two->next->data == 5 && clinkedlist_length(list) == 4);
+    CHECK((intptr_t)clinkedlist_remove(list, two) == 2);
+    CHECK(!clinkedlist_find(list, (void*)2, compare_ints));
+
+    clinkedlist_t *clone = clinkedlist_clone(list);
+    CHECK(clinkedlist_length(clone) == 3);
+    CHECK((intptr_t)clinkedlist_pop_front(list) == 3);
+    CHECK((intptr_t)clinkedlist_pop_front(list) == 5);
+    CHECK((intptr_t)clinkedlist_pop_front(list) == 1);
+    CHECK(!clinkedlist_pop_front(list) && clinkedlist_length(list) == 0);
+    CHECK((intptr_t)clone->head->data == 3);
+    clinkedlist_destroy(list);
+    clinkedlist_destroy(clone);
+
+    cdouble_linked_list_t *dlist = cdouble_linked_list_create();
+    cdouble_linked_list_push_back(dlist, (void*)2);
+    cdouble_linked_list_push_front(dlist, (void*)1);
+    cdouble_linked_list_push_back(dlist, (void*)4);
+    cdouble_linked_list_node_t *four = cdouble_linked_list_find(dlist, (void*)4, compare_ints);
+    cdouble_linked_list_insert_before(dlist, four, (void*)3);
+    CHECK(cdouble_linked_list_length(dlist) == 4);
+    CHECK((intptr_t)four->prev->data == 3 && (intptr_t)four->prev->prev->data == 2);
+    CHECK((intptr_t)cdouble_linked_list_pop_back(dlist) == 4);
+    CHECK((intptr_t)cdouble_linked_list_pop_front(dlist) == 1);
+    CHECK((intptr_t)dlist->head->data == 2 && (intptr_t)dlist->tail->data == 3);
+    //The list is circular
+    CHECK(dlist->head->prev == dlist->tail && dlist->tail->next == dlist->head);
+    cdouble_linked_list_destroy(dlist);
+
+    //Pushes cross several chunks and come back out in order
+    cchunked_list_t *chunked = cchunked_list_create(4);
+    for (intptr_t i = 0; i < 10; i++)
+        cchunked_list_push_back(chunked, (void*)i);
+    CHECK(cchunked_list_length(chunked) == 10 && !cchunked_list_is_empty(chunked));
+    cchunked_list_t *chunked_clone = cchunked_list_clone(chunked);
+    bool ordered = true;
+    for (intptr_t i = 0; i < 10; i++)
+        ordered &= (intptr_t)cchunked_list_pop_front(chunked) == i;
+    CHECK(ordered);
+    CHECK(cchunked_list_is_empty(chunked));
+    CHECK(cchunked_list_length(chunked_clone) == 10);
+    cchunked_list_destroy(chunked);
+    cchunked_list_destroy(chunked_clone);
+}
+
+static void test_queue(){
+    CQueue q;
+    cqueue_init(&q, 4, sizeof(uint32_t));
+    CHECK(cqueue_is_empty(&q));
+    for (uint32_t i = 0; i < 4; i++)
+        CHECK(cqueue_enqueue(&q, &i));
+    uint32_t extra = 99;
+    CHECK(!cqueue_enqueue(&q, &extra));
+    uint32_t out;
+    CHECK(cqueue_dequeue(&q, &out) && out == 0);
+    CHECK(cqueue_enqueue(&q, &extra));
+    bool ordered = true;
+    uint32_t expected[] = { 1, 2, 3, 99 };
+    for (int i = 0; i < 4; i++)
+        ordered &= cqueue_dequeue(&q, &out) && out == expected[i];
+    CHECK(ordered);
+    CHECK(!cqueue_dequeue(&q, &out));
+    cqueue_destroy(&q);
+
+    //No limit, so it grows and keeps its order across the wrap
+    cqueue_init(&q, 0, sizeof(uint64_t));
+    for (uint64_t i = 0; i < 100; i++)
+        cqueue_enqueue(&q, &i);
+    CHECK(cqueue_size(&q) == 100);
+    uint64_t value;
+    ordered = true;
+    for (uint64_t i = 0; i < 100; i++)
+        ordered &= cqueue_dequeue(&q, &value) && value == i;
+    CHECK(ordered);
+    cqueue_clear(&q);
+    CHECK(cqueue_is_empty(&q));
+    cqueue_destroy(&q);
+}
+
+static void test_ring_buffer(){
+    uint16_t storage[3];
+    CRingBuffer rb;
+    cring_init(&rb, storage, 3, sizeof(uint16_t));
+    CHECK(cring_capacity(&rb) == 3 && cring_is_empty(&rb));
+    for (uint16_t i = 1; i <= 3; i++)
+        CHECK(cring_push(&rb, &i));
+    CHECK(cring_is_full(&rb));
+    uint16_t extra = 4;
+    CHECK(!cring_push(&rb, &extra));
+    uint16_t out;
+    CHECK(cring_pop(&rb, &out) && out == 1);
+    CHECK(cring_push(&rb, &extra));
+    bool ordered = true;
+    for (uint16_t i = 2; i <= 4; i++)
+        ordered &= cring_pop(&rb, &out) && out == i;
+    CHECK(ordered);
+    CHECK(!cring_pop(&rb, &out) && cring_is_empty(&rb));
+    cring_push(&rb, &extra);
+    cring_clear(&rb);
+    CHECK(cring_is_empty(&rb));
+}
+
+static void test_checksums(){
+    //The RFC 1071 example
+    uint16_t words[] = { 0x0001, 0xF203, 0xF4F5, 0xF6F7 };
+    CHECK(checksum16(words, 4) == 0x220D);
+    CHECK(checksum16(words, 0) == 0xFFFF);
+
+    //A header summed with its own checksum in place comes out as 0
+    uint16_t header[10] = { 0x4500, 0x0073, 0x0000, 0x4000, 0x4011, 0, 0xC0A8, 0x0001, 0xC0A8, 0x00C7 };
+    header[5] = checksum16(header, 10);
+    CHECK(header[5] == 0xB861);
+    CHECK(checksum16(header, 10) == 0);
+
+    //Same for the pseudo header, with an odd length payload whose last byte is padded
+    uint8_t udp[11] = { 0x30, 0x39, 0x00, 0x35, 0x00, 0x0B, 0, 0, 'a', 'b', 'c' };
+    uint16_t sum = checksum16_pipv4(0xC0A80001, 0xC0A800C7, 17, udp, sizeof(udp));
+    udp[6] = sum >> 8;
+    udp[7] = sum & 0xFF;
+    CHECK(checksum16_pipv4(0xC0A80001, 0xC0A800C7, 17, udp, sizeof(udp)) == 0);
+}
+
+#define FB_TEST_WIDTH 64
+#define FB_TEST_HEIGHT 32
+
+static uint32_t count_pixels(uint32_t *fb, uint32_t color){
+    uint32_t count = 0;
+    for (int i = 0; i < FB_TEST_WIDTH * FB_TEST_HEIGHT; i++)
+        count += fb[i] == color;
+    return count;
+}
+
+static void test_draw(){
+    //One extra row past the bounds catches anything drawn outside them
+    static uint32_t fb[FB_TEST_WIDTH * (FB_TEST_HEIGHT + 1)];
+    uint32_t *guard = fb + FB_TEST_WIDTH * FB_TEST_HEIGHT;
+    fb_set_stride(FB_TEST_WIDTH * 4);
+    fb_set_bounds(FB_TEST_WIDTH, FB_TEST_HEIGHT);
+
+    fb_clear(fb, 0xFF000000);
+    CHECK(count_pixels(fb, 0xFF000000) == FB_TEST_WIDTH * FB_TEST_HEIGHT);
+    CHECK(guard[0] == 0);
+    full_redraw = false;
+    dirty_count = 0;
+
+    fb_fill_rect(fb, 10, 5, 4, 3, 0xFFFF0000);
+    CHECK(count_pixels(fb, 0xFFFF0000) == 12);
+    CHECK(fb[5 * FB_TEST_WIDTH + 10] == 0xFFFF0000 && fb[7 * FB_TEST_WIDTH + 13] == 0xFFFF0000);
+    CHECK(fb[5 * FB_TEST_WIDTH + 14] == 0xFF000000 && fb[8 * FB_TEST_WIDTH + 10] == 0xFF000000);
+    CHECK(dirty_count == 1 && dirty_rects[0].point.x == 10 && dirty_rects[0].size.height == 3);
+
+    //Rects hanging off the edge are clipped, pixels and dirty area both
+    fb_fill_rect(fb, 60, 30, 10, 10, 0xFF00FF00);
+    CHECK(count_pixels(fb, 0xFF00FF00) == 8);
+    bool guard_clear = true;
+    for (int i = 0; i < FB_TEST_WIDTH; i++)
+        guard_clear &= guard[i] == 0;
+    CHECK(guard_clear);
+    CHECK(dirty_count == 2 && dirty_rects[1].size.width == 4 && dirty_rects[1].size.height == 2);
+
+    fb_draw_pixel(fb, FB_TEST_WIDTH, 0, 0xFFFFFFFF);
+    fb_draw_pixel(fb, 0, FB_TEST_HEIGHT, 0xFFFFFFFF);
+    CHECK(count_pixels(fb, 0xFFFFFFFF) == 0);
+
+    //Overlapping dirty areas merge into one
+    mark_dirty(11, 6, 10, 10);
+    CHECK(dirty_count == 2 && dirty_rects[0].size.width == 11 && dirty_rects[0].size.height == 11);
+
+    fb_clear(fb, 0);
+    gpu_rect line = fb_draw_line(fb, 2, 3, 12, 3, 0xFFFFFFFF);
+    CHECK(count_pixels(fb, 0xFFFFFFFF) == 11);
+    CHECK(line.point.x == 2 && line.point.y == 3 && line.size.width == 11 && line.size.height == 1);
+
+    fb_clear(fb, 0);
+    line = fb_draw_line(fb, 9, 9, 0, 0, 0xFFFFFFFF);
+    CHECK(count_pixels(fb, 0xFFFFFFFF) == 10);
+    CHECK(fb[0] == 0xFFFFFFFF && fb[4 * FB_TEST_WIDTH + 4] == 0xFFFFFFFF && fb[9 * FB_TEST_WIDTH + 9] == 0xFFFFFFFF);
+    CHECK(line.point.x == 0 && line.point.y == 0 && line.size.width == 10 && line.size.height == 10);
+
+    //Glyphs stay inside their scaled cell
+    fb_clear(fb, 0);
+    fb_draw_char(fb, 8, 8, 'A', 2, 0xFFFFFFFF);
+    uint32_t lit = count_pixels(fb, 0xFFFFFFFF);
+    uint32_t inside = 0;
+    for (int y = 8; y < 24; y++)
+        for (int x = 8; x < 24; x++)
+            inside += fb[y * FB_TEST_WIDTH + x] == 0xFFFFFFFF;
+    CHECK(lit > 0 && lit == inside && lit % 4 == 0);
+    CHECK(fb_get_char_size(2) == 16);
+}
+
+static void test_malloc(){
+    //Zeroed, 16 byte aligned and distinct, across every class
+    uintptr_t blocks[8];
+    bool fresh = true;
+    for (int c = 0; c < 8; c++){
+        size_t size = 16 << c;
+        blocks[c] = malloc(size);
+        fresh &= blocks[c] && !(blocks[c] & 15);
+        for (size_t i = 0; i < size; i++)
+            fresh &= ((uint8_t*)blocks[c])[i] == 0;
+        memset((void*)blocks[c], 0xAB, size);
+    }
+    CHECK(fresh);
+    bool disjoint = true;
+    for (int a = 0; a < 8; a++)
+        for (int b = 0; b < 8; b++)
+            if (a != b)
+                disjoint &= blocks[a] + (16 << a) <= blocks[b] || blocks[b] + (16 << b) <= blocks[a];
+    CHECK(disjoint);
+
+    //A freed block is the next one handed out for its class, and comes back zeroed
+    free((void*)blocks[3], 128);
+    uintptr_t again = malloc(100);
+    CHECK(again == blocks[3]);
+    CHECK(((uint8_t*)again)[0] == 0 && ((uint8_t*)again)[99] == 0);
+    for (int c = 0; c < 8; c++)
+        free((void*)blocks[c], 16 << c);
+
+    //Past the largest class every allocation gets its own pages
+    uintptr_t large = malloc(5000);
+    CHECK(large && !(large & 0xFFF));
+    ((uint8_t*)large)[4999] = 1;
+    free((void*)large, 5000);
+
+    //Enough small blocks to need more than one chunk
+    bool all = true;
+    for (int i = 0; i < 5000; i++)
+        all &= malloc(24) != 0;
+    CHECK(all);
+    CHECK(!malloc(0));
+}
+
+int main(){
+    test_string();
+    test_string_format();
+    test_string_builder();
+    test_linked_list();
+    test_queue();
+    test_ring_buffer();
+    test_checksums();
+    test_draw();
+    test_malloc();
+    printf("[test] %i checks, %i failed", checks, failures);
+    return failures;
+}
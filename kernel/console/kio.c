@@ -3,9 +3,10 @@
 #include "kconsole/kconsole.h"
 #include "std/string.h"
 #include "memory/page_allocator.h"
+#include "memory/slab.h"
 
 static bool use_visual = true;
-void* print_buf;
+static kmem_cache print_cache = KMEM_CACHE("kprintf", 256, ALIGN_64B, false);
 
 bool console_init(){
     enable_uart();
@@ -62,22 +63,16 @@ void putc(const char c){
         kconsole_putc(c);
 }
 
-void init_print_buf(){
-    print_buf = palloc(0x1000,true, false, false);
-}
-
 void kprintf(const char *fmt, ...){
-    if (!print_buf) init_print_buf();
     va_list args;
     va_start(args, fmt);
-    char* buf = kalloc(print_buf, 256, ALIGN_64B, true, false);
+    char* buf = kmem_cache_alloc(&print_cache);
     size_t len = string_format_va_buf(fmt, buf, args);
     va_end(args);
     puts(buf);
     putc('\r');
     putc('\n');
-    //TODO: these buffers should be freed sometime, maybe after writing them to disk, and even those should be wiped eventually
-    // kfree((void*)buf, 256);
+    kmem_cache_free(&print_cache, buf);
 }
 
 void kprint(const char *fmt){
@@ -87,14 +82,13 @@ void kprint(const char *fmt){
 }
 
 void kputf(const char *fmt, ...){
-    if (!print_buf) init_print_buf();
     va_list args;
     va_start(args, fmt);
-    char* buf = kalloc(print_buf, 256, ALIGN_64B, true, false);
+    char* buf = kmem_cache_alloc(&print_cache);
     size_t len = string_format_va_buf(fmt, buf, args);
     va_end(args);
     puts(buf);
-    // kfree((void*)buf, 256);
+    kmem_cache_free(&print_cache, buf);
 }
 
 void disable_visual(){
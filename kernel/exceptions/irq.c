@@ -9,6 +9,8 @@
 #include "networking/network.h"
 #include "hw/hw.h"
 #include "audio/audio.h"
+#include "hw/smp.h"
+#include "ktimer.h"
 
 #define IRQ_TIMER 30
 #define SLEEP_TIMER 27
@@ -37,23 +39,39 @@ static void gic_enable_irq(uint32_t irq, uint8_t priority, uint8_t cpu_target) {
     write32(GICD_BASE + 0xC00 + config_offset, config);
 }
 
+//Timer PPIs, their enable and priority registers and the CPU interface are banked, so every core sets up its own
+void gic_cpu_init() {
+    if (RPI_BOARD == 3) return;
+
+    gic_enable_irq(IRQ_TIMER, 0x80, 0);
+    gic_enable_irq(SLEEP_TIMER, 0x80, 0);
+
+    write32(GICC_BASE + 0x004, 0xF0); //Priority
+
+    write32(GICC_BASE, 1); // Enable CPU Interface
+}
+
+void gic_send_sgi(uint16_t core, uint8_t sgi) {
+    if (RPI_BOARD == 3) return;
+    write32(GICD_BASE + 0xF00, (1 << (16 + core)) | (sgi & 0xF));
+}
+
 void irq_init() {
     if (RPI_BOARD != 3){
         write32(GICD_BASE, 0); // Disable Distributor
         write32(GICC_BASE, 0); // Disable CPU Interface
     }
 
-    gic_enable_irq(IRQ_TIMER, 0x80, 0);
-    gic_enable_irq(MSI_OFFSET + INPUT_IRQ, 0x80, 0);
-    gic_enable_irq(MSI_OFFSET + NET_IRQ, 0x80, 0);
-    gic_enable_irq(MSI_OFFSET + NET_IRQ + 1, 0x80, 0);
-    gic_enable_irq(SLEEP_TIMER, 0x80, 0);
-    gic_enable_irq(MSI_OFFSET + AUDIO_IRQ, 0x80, 0);
+    //Device interrupts are routed to core 0
+    gic_enable_irq(IRQ_TIMER, 0x80, 1);
+    gic_enable_irq(MSI_OFFSET + INPUT_IRQ, 0x80, 1);
+    gic_enable_irq(MSI_OFFSET + NET_IRQ, 0x80, 1);
+    gic_enable_irq(MSI_OFFSET + NET_IRQ + 1, 0x80, 1);
+    gic_enable_irq(SLEEP_TIMER, 0x80, 1);
+    gic_enable_irq(MSI_OFFSET + AUDIO_IRQ, 0x80, 1);
 
     if (RPI_BOARD != 3){
-        write32(GICC_BASE + 0x004, 0xF0); //Priority
-
-        write32(GICC_BASE, 1); // Enable CPU Interface
+        gic_cpu_init();
         write32(GICD_BASE, 1); // Enable Distributor
 
         kprint("[GIC] GIC enabled");
@@ -73,42 +91,50 @@ void disable_interrupt(){
 }
 
 void irq_el1_handler() {
+    //The entry stub has already moved to the kernel stack
     save_context_registers();
     save_return_address_interrupt();
-    if (ksp != 0){
-        asm volatile ("mov sp, %0" :: "r"(ksp));
-    }
+    kernel_lock();
+    fpu_kernel_enter();
     uint32_t irq;
+    uint32_t iar = 0;
     if (RPI_BOARD == 3){
         irq = 31 - __builtin_clz(read32(GICD_BASE + 0x204));
-    } else irq = read32(GICC_BASE + 0xC);
+    } else {
+        //SGIs carry the sender core in bits 10-12, which must be kept for the EOI
+        iar = read32(GICC_BASE + 0xC);
+        irq = iar & 0x3FF;
+    }
 
-    if (irq == IRQ_TIMER) {
-        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, irq);
+    if (irq == IPI_RESCHEDULE && RPI_BOARD != 3){
+        write32(GICC_BASE + 0x10, iar);
+        process_restore();
+    } else if (irq == IRQ_TIMER) {
+        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, iar);
         switch_proc(INTERRUPT);
     } else if (irq == MSI_OFFSET + INPUT_IRQ){
         handle_input_interrupt();
-        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, irq);
+        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, iar);
         process_restore();
     } else if (irq == SLEEP_TIMER){
-        wake_processes();
-        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, irq);
+        ktimer_expire();
+        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, iar);
         process_restore();
     } else if (irq == MSI_OFFSET + NET_IRQ){
         network_handle_download_interrupt();
-        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, irq);
+        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, iar);
         process_restore();
     } else if (irq == MSI_OFFSET + NET_IRQ + 1){
         network_handle_upload_interrupt();
-        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, irq);
+        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, iar);
         process_restore();
     } else if (irq == MSI_OFFSET + AUDIO_IRQ){
         audio_handle_interrupt();
-        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, irq);
+        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, iar);
         process_restore();
     } else {
         kprintf("[GIC error] Received unknown interrupt %i",irq);
-        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, irq);
+        if (RPI_BOARD != 3) write32(GICC_BASE + 0x10, iar);
         process_restore();
     }
 }
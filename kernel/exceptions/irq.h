@@ -3,7 +3,11 @@
 #include "types.h"
 #include "hw/hw.h"
 
+#define IPI_RESCHEDULE 0
+
 void irq_init();
+void gic_cpu_init();
+void gic_send_sgi(uint16_t core, uint8_t sgi);
 void irq_el1_handler();
 void disable_interrupt();
 void enable_interrupt();
@@ -0,0 +1,114 @@
+#include "ktimer.h"
+#include "timer.h"
+#include "memory/page_allocator.h"
+
+#define KTIMER_CHUNK_ENTRIES (PAGE_SIZE / sizeof(ktimer*))
+#define KTIMER_MAX_CHUNKS 256
+
+//Binary min-heap ordered by deadline. Each timer tracks its own slot so cancelling is O(log n) too.
+//Slots are kept in page sized chunks that are added as the heap grows, like the process table
+static ktimer *first_chunk[KTIMER_CHUNK_ENTRIES];
+static ktimer **chunks[KTIMER_MAX_CHUNKS] = { first_chunk };
+static uint32_t heap_size;
+static uint32_t heap_capacity = KTIMER_CHUNK_ENTRIES;
+
+#define heap(index) chunks[(index) / KTIMER_CHUNK_ENTRIES][(index) % KTIMER_CHUNK_ENTRIES]
+
+static bool heap_grow(){
+    uint32_t chunk = heap_capacity / KTIMER_CHUNK_ENTRIES;
+    if (chunk >= KTIMER_MAX_CHUNKS) return false;
+    chunks[chunk] = (ktimer**)palloc(PAGE_SIZE, true, false, true);
+    if (!chunks[chunk]) return false;
+    heap_capacity += KTIMER_CHUNK_ENTRIES;
+    return true;
+}
+
+static void heap_place(ktimer *timer, uint32_t index){
+    heap(index) = timer;
+    timer->heap_index = index;
+}
+
+static void sift_up(uint32_t index){
+    ktimer *timer = heap(index);
+    while (index > 0){
+        uint32_t parent = (index - 1) / 2;
+        if (heap(parent)->deadline <= timer->deadline) break;
+        heap_place(heap(parent), index);
+        index = parent;
+    }
+    heap_place(timer, index);
+}
+
+static void sift_down(uint32_t index){
+    ktimer *timer = heap(index);
+    while (1){
+        uint32_t child = (index * 2) + 1;
+        if (child >= heap_size) break;
+        if (child + 1 < heap_size && heap(child + 1)->deadline < heap(child)->deadline)
+            child++;
+        if (timer->deadline <= heap(child)->deadline) break;
+        heap_place(heap(child), index);
+        index = child;
+    }
+    heap_place(timer, index);
+}
+
+static void heap_remove(uint32_t index){
+    heap_size--;
+    if (index == heap_size) return;
+    heap_place(heap(heap_size), index);
+    sift_down(index);
+    sift_up(heap(index)->heap_index);
+}
+
+static void program_next(){
+    if (heap_size)
+        virtual_timer_set_deadline(heap(0)->deadline);
+    else
+        virtual_timer_disable();
+}
+
+void ktimer_init(ktimer *timer, ktimer_callback callback, void *ctx){
+    timer->deadline = 0;
+    timer->callback = callback;
+    timer->ctx = ctx;
+    timer->heap_index = 0;
+    timer->armed = false;
+}
+
+bool ktimer_arm(ktimer *timer, uint64_t msec){
+    return ktimer_arm_at(timer, timer_now() + timer_msec_to_ticks(msec));
+}
+
+bool ktimer_arm_at(ktimer *timer, uint64_t deadline){
+    if (timer->armed)
+        ktimer_cancel(timer);
+    if (heap_size == heap_capacity && !heap_grow()) return false;
+    timer->deadline = deadline;
+    timer->armed = true;
+    heap_place(timer, heap_size++);
+    sift_up(timer->heap_index);
+    if (heap(0) == timer)
+        program_next();
+    return true;
+}
+
+void ktimer_cancel(ktimer *timer){
+    if (!timer->armed) return;
+    bool was_first = timer->heap_index == 0;
+    heap_remove(timer->heap_index);
+    timer->armed = false;
+    if (was_first)
+        program_next();
+}
+
+void ktimer_expire(){
+    uint64_t now = timer_now();
+    while (heap_size && heap(0)->deadline <= now){
+        ktimer *timer = heap(0);
+        heap_remove(0);
+        timer->armed = false;
+        timer->callback(timer->ctx);
+    }
+    program_next();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*ktimer_callback)(void *ctx);
+
+//One-shot kernel timer. Deadlines are absolute counter ticks, callbacks run from the timer interrupt
+typedef struct ktimer {
+    uint64_t deadline;
+    ktimer_callback callback;
+    void *ctx;
+    uint32_t heap_index;
+    bool armed;
+} ktimer;
+
+void ktimer_init(ktimer *timer, ktimer_callback callback, void *ctx);
+//Only fails when no memory is left to grow the timer heap
+bool ktimer_arm(ktimer *timer, uint64_t msec);
+bool ktimer_arm_at(ktimer *timer, uint64_t deadline);
+void ktimer_cancel(ktimer *timer);
+void ktimer_expire();
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,8 @@
 #include "timer.h"
+#include "syscalls/vdso.h"
+#include "memory/mmu.h"
+
+static vdso_time_page vdso_page __attribute__((aligned(0x1000)));
 
 static uint64_t _msecs;
 
@@ -12,7 +16,20 @@ void timer_reset() {
 void timer_enable() {
     uint64_t val = 1;
     asm volatile ("msr cntp_ctl_el0, %0" :: "r"(val));
-    asm volatile ("msr cntkctl_el1, %0" :: "r"(val));
+    //EL0PCTEN | EL0VCTEN, the vDSO reads the virtual counter from EL0
+    uint64_t kctl = 0b11;
+    asm volatile ("msr cntkctl_el1, %0" :: "r"(kctl));
+}
+
+//Stops the scheduler tick until the next timer_start. Used when there's nothing else to switch to
+void timer_stop(){
+    uint64_t ctl = 0;
+    asm volatile ("msr cntp_ctl_el0, %0" :: "r"(ctl));
+}
+
+void timer_start(){
+    timer_reset();
+    timer_enable();
 }
 
 void permanent_disable_timer(){
@@ -38,6 +55,16 @@ void virtual_timer_enable() {
     asm volatile ("msr cntv_ctl_el0, %0" :: "r"(val));
 }
 
+void virtual_timer_set_deadline(uint64_t ticks) {
+    asm volatile ("msr cntv_cval_el0, %0" :: "r"(ticks));
+    virtual_timer_enable();
+}
+
+void virtual_timer_disable() {
+    uint64_t val = 0;
+    asm volatile ("msr cntv_ctl_el0, %0" :: "r"(val));
+}
+
 uint64_t virtual_timer_remaining_msec() {
     uint64_t ticks;
     uint64_t freq;
@@ -52,9 +79,30 @@ uint64_t timer_now() {
     return val;
 }
 
+uint64_t timer_msec_to_ticks(uint64_t msec) {
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+    return (freq * msec) / 1000;
+}
+
 uint64_t timer_now_msec() {
     uint64_t ticks, freq;
     asm volatile ("mrs %0, cntvct_el0" : "=r"(ticks));
     asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
     return (ticks * 1000) / freq;
-}
\ No newline at end of file
+}
+//Publishes the counter frequency and conversion constants for vdso_time_ns/us/ms
+void timer_vdso_init() {
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+    vdso_page.seq++;
+    asm volatile ("dmb ishst" ::: "memory");
+    vdso_page.freq = freq;
+    vdso_page.shift = VDSO_TIME_SHIFT;
+    vdso_page.mult_ns = (1000000000ULL << VDSO_TIME_SHIFT) / freq;
+    vdso_page.mult_us = (1000000ULL << VDSO_TIME_SHIFT) / freq;
+    vdso_page.mult_ms = (1000ULL << VDSO_TIME_SHIFT) / freq;
+    asm volatile ("dmb ishst" ::: "memory");
+    vdso_page.seq++;
+    register_user_readonly_memory(VDSO_TIME_ADDR, (uintptr_t)&vdso_page);
+}
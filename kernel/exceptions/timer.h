@@ -4,12 +4,19 @@
 
 void timer_init(uint64_t msecs);
 void timer_reset();
+void timer_start();
+void timer_stop();
 
 void virtual_timer_reset(uint64_t smsecs);
 void virtual_timer_enable();
+void virtual_timer_set_deadline(uint64_t ticks);
+void virtual_timer_disable();
 uint64_t virtual_timer_remaining_msec();
 
 uint64_t timer_now();
 uint64_t timer_now_msec();
+uint64_t timer_msec_to_ticks(uint64_t msec);
 
-void permanent_disable_timer();
\ No newline at end of file
+void permanent_disable_timer();
+
+void timer_vdso_init();
\ No newline at end of file
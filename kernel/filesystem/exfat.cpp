@@ -100,7 +100,7 @@ void* ExFATFS::read_full_file(uint32_t cluster_start, uint32_t cluster_size, uin
 
     char *buffer = (char*)read_cluster(cluster_start, cluster_size, cluster_count, root_index);
 
-    void *file = kalloc(fs_page, file_size, ALIGN_64B, true, true);
+    void *file = kalloc_uninit(fs_page, file_size, ALIGN_64B, true, true);
 
     memcpy(file, (void*)buffer, file_size);
     
@@ -1,12 +1,15 @@
 #include "fat32.hpp"
 #include "disk.h"
 #include "memory/page_allocator.h"
+#include "memory/slab.h"
 #include "console/kio.h"
 #include "memory/memory_access.h"
 #include "std/string.h"
 #include "std/memfunctions.h"
 #include "math/math.h"
 
+static kmem_cache filename_cache = KMEM_CACHE("fat32_filename", 255, ALIGN_64B, false);
+
 #define kprintfv(fmt, ...) \
     ({ \
         if (verbose){\
@@ -74,7 +77,7 @@ sizedptr FAT32FS::read_cluster(uint32_t cluster_start, uint32_t cluster_size, ui
     kprintfv("Reading cluster(s) %i-%i, starting from %i (LBA %i) Address %x", root_index, root_index+cluster_count, cluster_start, lba, lba * 512);
 
     size_t size = cluster_count * cluster_size * 512;
-    void* buffer = kalloc(fs_page, size, ALIGN_64B, true, true);
+    void* buffer = kalloc_uninit(fs_page, size, ALIGN_64B, true, true);
     
     if (cluster_count > 0){
         uint32_t next_index = root_index;
@@ -138,7 +141,7 @@ sizedptr FAT32FS::walk_directory(uint32_t cluster_count, uint32_t root_index, co
             continue;
         }
         bool long_name = buffer[i + 0xB] == 0xF;
-        char *filename = (char*)kalloc(fs_page, 255, ALIGN_64B, true, true);
+        char *filename = (char*)kmem_cache_alloc(&filename_cache);
         if (long_name){
             f32longname *first_longname = (f32longname*)&buffer[i];
             uint16_t count = 0;
@@ -153,7 +156,7 @@ sizedptr FAT32FS::walk_directory(uint32_t cluster_count, uint32_t root_index, co
             parse_shortnames(entry, filename);
         }
         sizedptr result = handler(this, entry, filename, seek);
-        kfree(filename, 255);
+        kmem_cache_free(&filename_cache, filename);
         if (result.ptr && result.size)
             return result;
         i += sizeof(f32file_entry);
@@ -181,7 +184,7 @@ sizedptr FAT32FS::list_directory(uint32_t cluster_count, uint32_t root_index) {
         }
         count++;
         bool long_name = buffer[i + 0xB] == 0xF;
-        char *filename = (char*)kalloc(fs_page, 255, ALIGN_64B, true, true);
+        char *filename = (char*)kmem_cache_alloc(&filename_cache);
         if (long_name){
             f32longname *first_longname = (f32longname*)&buffer[i];
             uint16_t count = 0;
@@ -201,7 +204,7 @@ sizedptr FAT32FS::list_directory(uint32_t cluster_count, uint32_t root_index) {
             f++;
         }
         *write_ptr++ = '\0';
-        kfree(filename, 255);
+        kmem_cache_free(&filename_cache, filename);
         i += sizeof(f32file_entry);
     }
 
@@ -215,7 +218,7 @@ sizedptr FAT32FS::read_full_file(uint32_t cluster_start, uint32_t cluster_size,
     sizedptr buf_ptr = read_cluster(cluster_start, cluster_size, cluster_count, root_index);
     char *buffer = (char*)buf_ptr.ptr;
 
-    void *file = kalloc(fs_page, file_size, ALIGN_64B, true, true);
+    void *file = kalloc_uninit(fs_page, file_size, ALIGN_64B, true, true);
 
     memcpy(file, (void*)buffer, file_size);
     
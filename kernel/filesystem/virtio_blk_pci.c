@@ -2,6 +2,7 @@
 #include "std/string.h"
 #include "memory/memory_access.h"
 #include "memory/page_allocator.h"
+#include "memory/slab.h"
 #include "console/kio.h"
 #include "pci.h"
 #include "virtio/virtio_pci.h"
@@ -29,6 +30,9 @@ struct virtio_blk_config {
     uint32_t blk_size;
 } __attribute__((packed));
 
+//Request headers are handed to the device, so they come from device memory
+static kmem_cache req_cache = KMEM_CACHE("virtio_blk_req", sizeof(struct virtio_blk_req), ALIGN_64B, true);
+
 #define VIRTIO_BLK_SUPPORTED_FEATURES \
     ((1 << 0) | (1 << 1) | (1 << 4))
 
@@ -70,8 +74,8 @@ bool vblk_find_disk(){
 }
 
 void vblk_write(const void *buffer, uint32_t sector, uint32_t count) {
-    void* cmd = kalloc(blk_dev.memory_page, sizeof(struct virtio_blk_req), ALIGN_64B, true, true);
-    void* data = kalloc(blk_dev.memory_page, count * 512, ALIGN_64B, true, true);
+    void* cmd = kmem_cache_alloc(&req_cache);
+    void* data = kalloc_uninit(blk_dev.memory_page, count * 512, ALIGN_64B, true, true);
 
     memcpy(data, buffer, count * 512);
 
@@ -83,13 +87,13 @@ void vblk_write(const void *buffer, uint32_t sector, uint32_t count) {
     virtio_send(&blk_dev, blk_dev.common_cfg->queue_desc, blk_dev.common_cfg->queue_driver, blk_dev.common_cfg->queue_device,
         (uintptr_t)cmd, sizeof(struct virtio_blk_req), (uintptr_t)data, count * 512, 0);
 
-    kfree((void *)cmd,sizeof(struct virtio_blk_req));
+    kmem_cache_free(&req_cache, cmd);
     kfree((void *)data,count * 512);
 }
 
 void vblk_read(void *buffer, uint32_t sector, uint32_t count) {
-    void* cmd = kalloc(blk_dev.memory_page, sizeof(struct virtio_blk_req), ALIGN_64B, true, true);
-    void* data = kalloc(blk_dev.memory_page, count * 512, ALIGN_64B, true, true);
+    void* cmd = kmem_cache_alloc(&req_cache);
+    void* data = kalloc_uninit(blk_dev.memory_page, count * 512, ALIGN_64B, true, true);
 
     struct virtio_blk_req *req = (struct virtio_blk_req *)cmd;
     req->type = VIRTIO_BLK_T_IN;
@@ -100,6 +104,6 @@ void vblk_read(void *buffer, uint32_t sector, uint32_t count) {
 
     memcpy(buffer, (void *)(uintptr_t)data, count * 512);
 
-    kfree((void *)cmd,sizeof(struct virtio_blk_req));
+    kmem_cache_free(&req_cache, cmd);
     kfree((void *)data,count * 512);
 }
\ No newline at end of file
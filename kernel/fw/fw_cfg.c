@@ -1,6 +1,7 @@
 #include "fw_cfg.h"
 #include "console/kio.h"
 #include "memory/memory_access.h"
+#include "memory/dma.h"
 #include "std/string.h"
 
 #define FW_CFG_DATA  0x09020000
@@ -36,12 +37,19 @@ void fw_cfg_dma_operation(void* dest, uint32_t size, uint32_t ctrl) {
         .control = __builtin_bswap32(ctrl),
     };
 
+    //Both the descriptor and the buffer live in cacheable memory, usually the stack
+    dma_sync_for_device(&access, sizeof(access));
+    dma_sync_for_device(dest, size);
+
     write64(FW_CFG_DMA, __builtin_bswap64((uint64_t)&access));
 
     __asm__("ISB");
 
-    while (__builtin_bswap32(access.control) & ~0x1) {}
-    
+    do {
+        dma_sync_for_cpu(&access, sizeof(access));
+    } while (__builtin_bswap32(access.control) & ~0x1);
+
+    dma_sync_for_cpu(dest, size);
 }
 
 void fw_cfg_dma_read(void* dest, uint32_t size, uint32_t ctrl){
@@ -1,6 +1,7 @@
 #include "ramfb.hpp"
 #include "fw/fw_cfg.h"
 #include "memory/kalloc.h"
+#include "memory/dma.h"
 #include "console/kio.h"
 #include "graph/font8x8_bridge.h"
 #include "ui/draw/draw.h"
@@ -49,8 +50,9 @@ bool RamFBGPUDriver::init(gpu_size preferred_screen_size){
 
     mem_page = palloc(0x1000, true, true, false);
 
-    framebuffer = (uintptr_t)kalloc(mem_page, fb_size, true, true, false);
-    back_framebuffer = (uintptr_t)kalloc(mem_page, fb_size, true, true, false);
+    //The scanned out buffer is never cached, drawing happens on the cacheable back buffer
+    framebuffer = (uintptr_t)dma_alloc_coherent(fb_size);
+    back_framebuffer = (uintptr_t)kalloc(mem_page, fb_size, ALIGN_4KB, true, false);
 
     ramfb_structure fb = {
         .addr = __builtin_bswap64(framebuffer),
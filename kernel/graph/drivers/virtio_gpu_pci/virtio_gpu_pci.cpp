@@ -1,6 +1,8 @@
 #include "virtio_gpu_pci.hpp"
 #include "pci.h"
 #include "memory/kalloc.h"
+#include "memory/slab.h"
+#include "memory/dma.h"
 #include "console/kio.h"
 #include "graph/font8x8_bridge.h"
 #include "ui/draw/draw.h"
@@ -59,7 +61,8 @@ bool VirtioGPUDriver::init(gpu_size preferred_screen_size){
     kprintf("Stride %i",screen_size.width * BPP);
     
     framebuffer_size = screen_size.width * screen_size.height * BPP;
-    framebuffer = (uintptr_t)kalloc(gpu_dev.memory_page, framebuffer_size, ALIGN_4KB, true, true);
+    //Cacheable, drawing is far more frequent than transfers. Each transfer cleans the rows it hands over
+    framebuffer = (uintptr_t)kalloc(gpu_dev.memory_page, framebuffer_size, ALIGN_4KB, true, false);
 
     fb_set_bounds(screen_size.width,screen_size.height);
     
@@ -112,8 +115,13 @@ typedef struct virtio_2d_resource {
     uint32_t height;
 } virtio_2d_resource;
 
+//Every command and response fits in one slot, the largest being the display info response
+#define GPU_CMD_SIZE 512
+static_assert(sizeof(virtio_gpu_resp_display_info) <= GPU_CMD_SIZE, "GPU command slots too small");
+static kmem_cache cmd_cache = KMEM_CACHE("virtio_gpu_cmd", GPU_CMD_SIZE, ALIGN_64B, true);
+
 gpu_size VirtioGPUDriver::get_display_info(){
-    virtio_gpu_ctrl_hdr* cmd = (virtio_gpu_ctrl_hdr*)kalloc(gpu_dev.memory_page, sizeof(virtio_gpu_ctrl_hdr), ALIGN_4KB, true, true);
+    virtio_gpu_ctrl_hdr* cmd = (virtio_gpu_ctrl_hdr*)kmem_cache_alloc(&cmd_cache);
     cmd->type = VIRTIO_GPU_CMD_GET_DISPLAY_INFO;
     cmd->flags = 0;
     cmd->fence_id = 0;
@@ -123,18 +131,18 @@ gpu_size VirtioGPUDriver::get_display_info(){
     cmd->padding[1] = 0;
     cmd->padding[2] = 0;
 
-    virtio_gpu_resp_display_info* resp = (virtio_gpu_resp_display_info*)kalloc(gpu_dev.memory_page, sizeof(virtio_gpu_resp_display_info), ALIGN_4KB, true, true);
+    virtio_gpu_resp_display_info* resp = (virtio_gpu_resp_display_info*)kmem_cache_alloc(&cmd_cache);
 
     if (!virtio_send(&gpu_dev, gpu_dev.common_cfg->queue_desc, gpu_dev.common_cfg->queue_driver, gpu_dev.common_cfg->queue_device,
         (uintptr_t)cmd, sizeof(virtio_gpu_ctrl_hdr), (uintptr_t)resp, sizeof(virtio_gpu_resp_display_info), VIRTQ_DESC_F_WRITE)){
-        kfree((void*)cmd, sizeof(virtio_gpu_ctrl_hdr));
-        kfree((void*)resp, sizeof(virtio_gpu_resp_display_info));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return (gpu_size){0, 0};
     }
 
     if (resp->hdr.type != 0x1101) {
-        kfree((void*)(void*)cmd, sizeof(virtio_gpu_ctrl_hdr));
-        kfree((void*)resp, sizeof(virtio_gpu_resp_display_info));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return (gpu_size){0, 0};
     }
 
@@ -143,20 +151,20 @@ gpu_size VirtioGPUDriver::get_display_info(){
             scanout_id = i;
             scanout_found = true;
             gpu_size size = {resp->pmodes[i].rect.width, resp->pmodes[i].rect.height};
-            temp_free(cmd, sizeof(virtio_gpu_ctrl_hdr));
-            temp_free(resp, sizeof(virtio_gpu_resp_display_info));
+            kmem_cache_free(&cmd_cache, cmd);
+            kmem_cache_free(&cmd_cache, resp);
             return size;
         }
     }
 
     scanout_found = false;
-    kfree((void*)cmd, sizeof(virtio_gpu_ctrl_hdr));
-    kfree((void*)resp, sizeof(virtio_gpu_resp_display_info));
+    kmem_cache_free(&cmd_cache, cmd);
+    kmem_cache_free(&cmd_cache, resp);
     return (gpu_size){0, 0};
 }
 
 bool VirtioGPUDriver::create_2d_resource(gpu_size size) {
-    virtio_2d_resource* cmd = (virtio_2d_resource*)kalloc(gpu_dev.memory_page, sizeof(virtio_2d_resource), ALIGN_4KB, true, true);
+    virtio_2d_resource* cmd = (virtio_2d_resource*)kmem_cache_alloc(&cmd_cache);
     
     cmd->hdr.type = VIRTIO_GPU_CMD_RESOURCE_CREATE_2D;
     cmd->hdr.flags = 0;
@@ -171,23 +179,23 @@ bool VirtioGPUDriver::create_2d_resource(gpu_size size) {
     cmd->width = size.width;
     cmd->height = size.height;
 
-    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kalloc(gpu_dev.memory_page, sizeof(virtio_gpu_ctrl_hdr), ALIGN_4KB, true, true);
+    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kmem_cache_alloc(&cmd_cache);
 
     if (!virtio_send(&gpu_dev, gpu_dev.common_cfg->queue_desc, gpu_dev.common_cfg->queue_driver, gpu_dev.common_cfg->queue_device,
         (uintptr_t)cmd, sizeof(virtio_2d_resource), (uintptr_t)resp, sizeof(virtio_gpu_ctrl_hdr), VIRTQ_DESC_F_WRITE)){
-        kfree((void*)cmd, sizeof(virtio_2d_resource));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
     
     if (resp->type != 0x1100) {
-        kfree((void*)cmd, sizeof(virtio_2d_resource));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
 
-    kfree((void*)cmd, sizeof(virtio_2d_resource));
-    kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+    kmem_cache_free(&cmd_cache, cmd);
+    kmem_cache_free(&cmd_cache, resp);
 
     return true;
 }
@@ -204,7 +212,7 @@ typedef struct virtio_backing_cmd {
 }__attribute__((packed)) virtio_backing_cmd;
 
 bool VirtioGPUDriver::attach_backing() {
-    virtio_backing_cmd* cmd = (virtio_backing_cmd*)kalloc(gpu_dev.memory_page, sizeof(virtio_backing_cmd), ALIGN_4KB, true, true);
+    virtio_backing_cmd* cmd = (virtio_backing_cmd*)kmem_cache_alloc(&cmd_cache);
 
     cmd->hdr.type = VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING;
     cmd->hdr.flags = 0;
@@ -221,23 +229,23 @@ bool VirtioGPUDriver::attach_backing() {
     cmd->entries[0].length = framebuffer_size;
     cmd->entries[0].padding = 0;
 
-    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kalloc(gpu_dev.memory_page, sizeof(virtio_gpu_ctrl_hdr), ALIGN_4KB, true, true);
+    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kmem_cache_alloc(&cmd_cache);
 
     if (!virtio_send2(&gpu_dev, gpu_dev.common_cfg->queue_desc, gpu_dev.common_cfg->queue_driver, gpu_dev.common_cfg->queue_device,
         (uintptr_t)cmd, sizeof(*cmd), (uintptr_t)resp, sizeof(virtio_gpu_ctrl_hdr), VIRTQ_DESC_F_NEXT)){
-        kfree((void*)cmd, sizeof(*cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
 
     if (resp->type != 0x1100) {
-        kfree((void*)cmd, sizeof(virtio_backing_cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
 
-    kfree((void*)cmd, sizeof(virtio_backing_cmd));
-    kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+    kmem_cache_free(&cmd_cache, cmd);
+    kmem_cache_free(&cmd_cache, resp);
     return true;
 }
 
@@ -249,7 +257,7 @@ typedef struct virtio_scanout_cmd {
 }__attribute__((packed)) virtio_scanout_cmd;
 
 bool VirtioGPUDriver::set_scanout() {
-    virtio_scanout_cmd* cmd = (virtio_scanout_cmd*)kalloc(gpu_dev.memory_page, sizeof(virtio_scanout_cmd), ALIGN_4KB, true, true);
+    virtio_scanout_cmd* cmd = (virtio_scanout_cmd*)kmem_cache_alloc(&cmd_cache);
     
     cmd->r.x = 0;
     cmd->r.y = 0;
@@ -268,23 +276,23 @@ bool VirtioGPUDriver::set_scanout() {
     cmd->hdr.padding[1] = 0;
     cmd->hdr.padding[2] = 0;
 
-    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kalloc(gpu_dev.memory_page, sizeof(virtio_gpu_ctrl_hdr), ALIGN_4KB, true, true);
+    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kmem_cache_alloc(&cmd_cache);
 
     if (!virtio_send(&gpu_dev, gpu_dev.common_cfg->queue_desc, gpu_dev.common_cfg->queue_driver, gpu_dev.common_cfg->queue_device,
         (uintptr_t)cmd, sizeof(*cmd), (uintptr_t)resp, sizeof(virtio_gpu_ctrl_hdr), VIRTQ_DESC_F_WRITE)){
-        kfree((void*)cmd, sizeof(virtio_scanout_cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
 
     if (resp->type != 0x1100) {
-        kfree((void*)cmd, sizeof(virtio_scanout_cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
 
-    kfree((void*)cmd, sizeof(virtio_scanout_cmd));
-    kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+    kmem_cache_free(&cmd_cache, cmd);
+    kmem_cache_free(&cmd_cache, resp);
     return true;
 }
 
@@ -297,7 +305,10 @@ typedef struct virtio_transfer_cmd {
 }__attribute__((packed)) virtio_transfer_cmd;
 
 bool VirtioGPUDriver::transfer_to_host(gpu_rect rect) {
-    virtio_transfer_cmd* cmd = (virtio_transfer_cmd*)kalloc(gpu_dev.memory_page, sizeof(virtio_transfer_cmd), ALIGN_4KB, true, true);
+    for (uint32_t y = rect.point.y; y < rect.point.y + rect.size.height; y++)
+        dma_sync_for_device((void*)(framebuffer + ((y * screen_size.width) + rect.point.x) * BPP), rect.size.width * BPP);
+
+    virtio_transfer_cmd* cmd = (virtio_transfer_cmd*)kmem_cache_alloc(&cmd_cache);
     
     cmd->hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
     cmd->hdr.flags = 0;
@@ -313,23 +324,23 @@ bool VirtioGPUDriver::transfer_to_host(gpu_rect rect) {
     cmd->rect.width = rect.size.width;
     cmd->rect.height = rect.size.height;
 
-    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kalloc(gpu_dev.memory_page, sizeof(virtio_gpu_ctrl_hdr), ALIGN_4KB, true, true);
+    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kmem_cache_alloc(&cmd_cache);
 
     if (!virtio_send(&gpu_dev, gpu_dev.common_cfg->queue_desc, gpu_dev.common_cfg->queue_driver, gpu_dev.common_cfg->queue_device,
         (uintptr_t)cmd, sizeof(virtio_transfer_cmd), (uintptr_t)resp, sizeof(virtio_gpu_ctrl_hdr), VIRTQ_DESC_F_WRITE)){
-        kfree((void*)cmd, sizeof(virtio_transfer_cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
 
     if (resp->type != 0x1100) {
-        kfree((void*)cmd, sizeof(virtio_transfer_cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return false;
     }
 
-    kfree((void*)cmd, sizeof(virtio_transfer_cmd));
-    kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+    kmem_cache_free(&cmd_cache, cmd);
+    kmem_cache_free(&cmd_cache, resp);
     return true;
 }
 
@@ -351,7 +362,7 @@ void VirtioGPUDriver::flush() {
         }
     }
     
-    virtio_flush_cmd* cmd = (virtio_flush_cmd*)kalloc(gpu_dev.memory_page, sizeof(virtio_flush_cmd), ALIGN_4KB, true, true);
+    virtio_flush_cmd* cmd = (virtio_flush_cmd*)kmem_cache_alloc(&cmd_cache);
     
     cmd->hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
     cmd->hdr.flags = 0;
@@ -366,23 +377,23 @@ void VirtioGPUDriver::flush() {
     cmd->rect.width = screen_size.width;
     cmd->rect.height = screen_size.height;
 
-    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kalloc(gpu_dev.memory_page, sizeof(virtio_gpu_ctrl_hdr), ALIGN_4KB, true, true);
+    virtio_gpu_ctrl_hdr* resp = (virtio_gpu_ctrl_hdr*)kmem_cache_alloc(&cmd_cache);
 
     if (!virtio_send(&gpu_dev, gpu_dev.common_cfg->queue_desc, gpu_dev.common_cfg->queue_driver, gpu_dev.common_cfg->queue_device,
         (uintptr_t)cmd, sizeof(virtio_flush_cmd), (uintptr_t)resp, sizeof(virtio_gpu_ctrl_hdr), VIRTQ_DESC_F_WRITE)){
-        kfree((void*)cmd, sizeof(virtio_flush_cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return;
     }
 
     if (resp->type != 0x1100) {
-        kfree((void*)cmd, sizeof(virtio_flush_cmd));
-        kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+        kmem_cache_free(&cmd_cache, cmd);
+        kmem_cache_free(&cmd_cache, resp);
         return;
     }
 
-    kfree((void*)cmd, sizeof(virtio_flush_cmd));
-    kfree((void*)resp, sizeof(virtio_gpu_ctrl_hdr));
+    kmem_cache_free(&cmd_cache, cmd);
+    kmem_cache_free(&cmd_cache, resp);
     return;
 }
 
@@ -0,0 +1,177 @@
+#include "smp.h"
+#include "hw.h"
+#include "dtb.h"
+#include "console/kio.h"
+#include "std/string.h"
+#include "memory/page_allocator.h"
+#include "memory/mmu.h"
+#include "memory/dma.h"
+#include "exceptions/exception_handler.h"
+#include "exceptions/irq.h"
+#include "exceptions/timer.h"
+#include "process/scheduler.h"
+#include "process/spinlock.h"
+
+#define PSCI_CPU_ON 0xC4000003
+#define PSCI_SUCCESS 0
+#define PSCI_ALREADY_ON -4
+
+#define SPIN_TABLE_BASE 0xD8
+
+#define CORE_START_TIMEOUT_MSEC 100
+
+#define CORE_UNSEEN 0
+#define CORE_STARTING 1
+#define CORE_PARKED 2
+
+extern void secondary_start();
+
+//Read by boot.S. Cores that firmware drops into _start wait in the pen until their slot holds an entry point
+volatile uint64_t smp_pen[MAX_CORES];
+uint64_t smp_stacks[MAX_CORES];
+
+//Set by smp_init for cores that missed their start timeout, so they park instead of joining late
+static volatile bool smp_abandoned[MAX_CORES];
+//Written by the secondaries with their caches off, so it has a line of its own the boot core never dirties
+static volatile struct {
+    uint64_t state[MAX_CORES];
+} __attribute__((aligned(64))) smp_arrival;
+
+static spinlock_t big_kernel_lock;
+static volatile int32_t kernel_lock_owner = -1;
+
+static bool psci_smc = false;
+
+void kernel_lock(){
+    uint16_t id = cpu_id();
+    if (kernel_lock_owner == id) return;
+    spin_lock(&big_kernel_lock);
+    kernel_lock_owner = id;
+}
+
+void kernel_unlock(){
+    if (kernel_lock_owner != cpu_id()) return;
+    kernel_lock_owner = -1;
+    spin_unlock(&big_kernel_lock);
+}
+
+void kernel_lock_yield(){
+    if (kernel_lock_owner != cpu_id() || !spin_contended(&big_kernel_lock)) return;
+    kernel_unlock();
+    kernel_lock();
+}
+
+bool kernel_lock_held(){
+    return kernel_lock_owner == cpu_id();
+}
+
+int handle_psci_node(const char *propname, const void *prop, uint32_t len, dtb_match_t *match) {
+    if (strcmp(propname, "method", false) == 0){
+        psci_smc = strcmp(prop, "smc", false) == 0;
+        match->found = true;
+        return 1;
+    }
+    return 0;
+}
+
+int64_t psci_cpu_on(uint64_t target, uint64_t entry){
+    register uint64_t x0 asm("x0") = PSCI_CPU_ON;
+    register uint64_t x1 asm("x1") = target;
+    register uint64_t x2 asm("x2") = entry;
+    register uint64_t x3 asm("x3") = 0;
+    if (psci_smc)
+        asm volatile ("smc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3) : "memory");
+    else
+        asm volatile ("hvc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3) : "memory");
+    return (int64_t)x0;
+}
+
+//Secondary cores run with their caches off until mmu_init_core, so everything they read before that has to be in RAM
+bool start_core(uint16_t core){
+    uintptr_t entry = (uintptr_t)&secondary_start;
+    smp_pen[core] = entry;
+    dma_sync_for_device((void*)&smp_pen[core], sizeof(uint64_t));
+    dma_sync_for_device(&smp_stacks[core], sizeof(uint64_t));
+    dma_sync_for_device((void*)&smp_arrival.state[core], sizeof(uint64_t));
+    if (BOARD_TYPE == 1){
+        int64_t result = psci_cpu_on(core, entry);
+        if (result != PSCI_SUCCESS && result != PSCI_ALREADY_ON) return false;
+    } else {
+        //The spin table sits right below the kernel image, inside the 2MB block that maps it
+        *(volatile uint64_t*)(uintptr_t)(SPIN_TABLE_BASE + (core * 8)) = entry;
+        dma_sync_for_device((void*)(uintptr_t)(SPIN_TABLE_BASE + (core * 8)), sizeof(uint64_t));
+    }
+    asm volatile ("dsb sy\nsev");
+    return true;
+}
+
+void secondary_kernel_main(){
+    uint16_t id = cpu_id();
+    //Announced before checking the flag, so that abandon_core either sees the core arrive or the core sees the flag
+    smp_arrival.state[id] = CORE_STARTING;
+    asm volatile ("dsb sy" ::: "memory");
+    if (smp_abandoned[id]){
+        smp_arrival.state[id] = CORE_PARKED;
+        asm volatile ("dsb sy" ::: "memory");
+        while (true)
+            asm volatile ("wfe");
+    }
+    set_exception_vectors();
+    mmu_init_core();
+    init_cpu_scheduler(id, smp_stacks[id]);
+    gic_cpu_init();
+
+    while (!scheduler_is_running())
+        asm volatile ("wfe");
+
+    start_scheduler();
+}
+
+uint16_t cores_online(){
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < MAX_CORES; i++)
+        if (get_cpu_online(i)) count++;
+    return count;
+}
+
+//Keeps a core that missed its start timeout from joining later. One that already got past the check in
+//secondary_kernel_main is waited for until it comes online or parks. Returns whether it came online
+static bool abandon_core(uint16_t core){
+    smp_abandoned[core] = true;
+    dma_sync_for_device((void*)&smp_abandoned[core], sizeof(bool));
+    uint64_t state;
+    do {
+        dma_sync_for_cpu((void*)&smp_arrival.state[core], sizeof(uint64_t));
+        state = smp_arrival.state[core];
+    } while (state == CORE_STARTING && !get_cpu_online(core));
+    return get_cpu_online(core);
+}
+
+void smp_init(){
+    //The BCM2836 local interrupt controller of the Pi 3 is not supported yet, secondary cores would never get a tick
+    if (BOARD_TYPE == 2 && RPI_BOARD == 3) return;
+
+    if (BOARD_TYPE == 1){
+        dtb_match_t match = {0};
+        dtb_scan("psci", handle_psci_node, &match);
+    }
+
+    for (uint16_t core = 1; core < MAX_CORES; core++){
+        uintptr_t stack = (uintptr_t)palloc(SMP_STACK_SIZE, true, false, true);
+        if (!stack) break;
+        //Stale lines over the stack would otherwise be evicted on top of what the core writes before enabling its caches
+        dma_sync_for_cpu((void*)stack, SMP_STACK_SIZE);
+        smp_stacks[core] = stack + SMP_STACK_SIZE;
+        if (!start_core(core)){
+            pfree((void*)stack, SMP_STACK_SIZE);
+            continue;
+        }
+        uint64_t deadline = timer_now_msec() + CORE_START_TIMEOUT_MSEC;
+        while (!get_cpu_online(core) && timer_now_msec() < deadline);
+        //The stack stays allocated either way, a late core may be running on it even once parked
+        if (!get_cpu_online(core) && !abandon_core(core))
+            kprintf("[SMP] Core %i did not come online", core);
+    }
+
+    kprintf("[SMP] %i cores online", cores_online());
+}
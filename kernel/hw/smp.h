@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+
+#define MAX_CORES 4
+#define SMP_STACK_SIZE 0x4000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline uint16_t cpu_id(){
+    uint64_t mpidr;
+    asm volatile ("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return mpidr & 0b11;
+}
+
+void smp_init();
+uint16_t cores_online();
+
+///Serializes all EL1 code. Held by a core while it runs a handler or a kernel process, released when it returns to EL0 or idles
+void kernel_lock();
+void kernel_unlock();
+void kernel_lock_yield();
+bool kernel_lock_held();
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,13 +2,14 @@
 #include "input_dispatch.h"
 #include "console/kio.h"
 #include "memory/page_allocator.h"
+#include "memory/dma.h"
 #include "usb.hpp"
 
 void USBKeyboard::request_data(USBDriver *driver){
     requesting = true;
 
     if (buffer == 0){
-        buffer = palloc(packet_size, true, true, true);
+        buffer = dma_alloc_coherent(packet_size);
     }
 
     if (!driver->poll(slot_id, endpoint, buffer, packet_size))
@@ -2,6 +2,7 @@
 #include "async.h"
 #include "console/kio.h"
 #include "memory/page_allocator.h"
+#include "memory/dma.h"
 #include "std/string.h"
 #include "memory/mmu.h"
 #include "hw/hw.h"
@@ -94,6 +95,9 @@ uint8_t DWC2Driver::address_device(uint8_t address){
 }
 
 bool DWC2Driver::make_transfer(dwc2_host_channel *channel, bool in, uint8_t pid, sizedptr data){
+    //Setup packets and small replies live on the stack, so the buffer is cacheable
+    if (data.size > 0)
+        dma_sync_for_device((void*)data.ptr, data.size);
     channel->dma = data.ptr;
     uint16_t max_size = packet_size(port_speed);
     uint32_t pkt_count = (data.size + max_size - 1)/max_size;
@@ -117,6 +121,9 @@ bool DWC2Driver::make_transfer(dwc2_host_channel *channel, bool in, uint8_t pid,
         return false;
     }
 
+    if (in && data.size > 0)
+        dma_sync_for_cpu((void*)data.ptr, data.size);
+
     return true;
 }
 
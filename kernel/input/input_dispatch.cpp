@@ -1,6 +1,7 @@
 #include "input_dispatch.h"
 #include "process/process.h"
 #include "process/scheduler.h"
+#include "process/process_events.h"
 #include "dwc2.hpp"
 #include "xhci.hpp"
 #include "hw/hw.h"
@@ -35,7 +36,8 @@ void register_keypress(keypress kp) {
 
     if (!(uintptr_t)focused_proc) return;
 
-    input_buffer_t* buf = &focused_proc->input_buffer;
+    input_buffer_t* buf = get_input_buffer(focused_proc);
+    if (!buf) return;
     uint32_t next_index = (buf->write_index + 1) % INPUT_BUFFER_CAPACITY;
 
     buf->entries[buf->write_index] = kp;
@@ -43,6 +45,8 @@ void register_keypress(keypress kp) {
 
     if (buf->write_index == buf->read_index)
         buf->read_index = (buf->read_index + 1) % INPUT_BUFFER_CAPACITY;
+
+    process_signal_event(focused_proc, EVENT_INPUT);
 }
 
 uint16_t sys_subscribe_shortcut_current(keypress kp){
@@ -65,10 +69,12 @@ void sys_focus_current(){
 void sys_set_focus(int pid){
     focused_proc = get_proc_by_pid(pid);
     focused_proc->focused = true;
+    reprioritize_process(focused_proc);
 }
 
 void sys_unset_focus(){
     focused_proc->focused = false;
+    reprioritize_process(focused_proc);
     focused_proc = 0;
 }
 
@@ -91,10 +97,12 @@ bool is_new_keypress(keypress* current, keypress* previous) {
 
 bool sys_read_input(int pid, keypress *out){
     process_t *process = get_proc_by_pid(pid);
-    if (process->input_buffer.read_index == process->input_buffer.write_index) return false;
+    if (!process || !process->input_buffer) return false;
+    input_buffer_t *buf = process->input_buffer;
+    if (buf->read_index == buf->write_index) return false;
 
-    *out = process->input_buffer.entries[process->input_buffer.read_index];
-    process->input_buffer.read_index = (process->input_buffer.read_index + 1) % INPUT_BUFFER_CAPACITY;
+    *out = buf->entries[buf->read_index];
+    buf->read_index = (buf->read_index + 1) % INPUT_BUFFER_CAPACITY;
     return true;
 }
 
@@ -135,10 +143,14 @@ void input_process_fake_interrupts(){
 }
 
 void init_input_process(){
-    if (!input_driver->use_interrupts)
-        create_kernel_process("input_poll", &input_process_poll);
-    if (input_driver->quirk_simulate_interrupts)
-        create_kernel_process("input_int_mock", &input_process_fake_interrupts);
+    if (!input_driver->use_interrupts){
+        process_t *proc = create_kernel_process("input_poll", &input_process_poll);
+        if (proc) set_process_priority(proc, PRIORITY_DRIVER);
+    }
+    if (input_driver->quirk_simulate_interrupts){
+        process_t *proc = create_kernel_process("input_int_mock", &input_process_fake_interrupts);
+        if (proc) set_process_priority(proc, PRIORITY_DRIVER);
+    }
 }
 
 void handle_input_interrupt(){
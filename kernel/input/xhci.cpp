@@ -6,6 +6,7 @@
 #include "usb_types.h"
 #include "hw/hw.h"
 #include "memory/memory_access.h"
+#include "memory/dma.h"
 #include "std/memfunctions.h"
 #include "async.h"
 #include "memory/memory_access.h"
@@ -149,9 +150,10 @@ bool XHCIDriver::init(){
     op->config = max_device_slots;
     kprintfv("[xHCI] %i device slots", max_device_slots);
 
+    //Descriptor arena for the shared USB code. Rings and contexts get coherent allocations of their own
     mem_page = palloc(0x1000, true, true, false);
 
-    uintptr_t dcbaap_addr = (uintptr_t)kalloc(mem_page, (max_device_slots + 1) * sizeof(uintptr_t), ALIGN_64B, true, true);
+    uintptr_t dcbaap_addr = (uintptr_t)dma_alloc_coherent((max_device_slots + 1) * sizeof(uintptr_t));
 
     op->dcbaap = dcbaap_addr;
 
@@ -161,14 +163,14 @@ bool XHCIDriver::init(){
 
     dcbaap = (uintptr_t*)dcbaap_addr;
 
-    uint64_t* scratchpad_array = (uint64_t*)kalloc(mem_page, (scratchpad_count == 0 ? 1 : scratchpad_count) * sizeof(uintptr_t), ALIGN_64B, true, true);
+    uint64_t* scratchpad_array = (uint64_t*)dma_alloc_coherent((scratchpad_count == 0 ? 1 : scratchpad_count) * sizeof(uintptr_t));
     for (uint32_t i = 0; i < scratchpad_count; i++)
-        scratchpad_array[i] = (uint64_t)kalloc(mem_page, 0x1000, ALIGN_64B, true, true);
+        scratchpad_array[i] = (uint64_t)dma_alloc_coherent(0x1000);
     dcbaap[0] = (uint64_t)scratchpad_array;
 
     kprintfv("[xHCI] dcbaap assigned at %x with %i scratchpads",dcbaap_addr,scratchpad_count);
 
-    command_ring.ring = (trb*)kalloc(mem_page, MAX_TRB_AMOUNT * sizeof(trb), ALIGN_64B, true, true);
+    command_ring.ring = (trb*)dma_alloc_coherent(MAX_TRB_AMOUNT * sizeof(trb));
 
     op->crcr = (uintptr_t)command_ring.ring | command_ring.cycle_bit;
 
@@ -254,8 +256,8 @@ bool XHCIDriver::enable_events(){
     kprintfv("[xHCI] Allocating ERST");
     interrupter = (xhci_interrupter*)(rt_base + 0x20);
 
-    uint64_t ev_ring = (uintptr_t)kalloc(mem_page, MAX_TRB_AMOUNT * sizeof(trb), ALIGN_64B, true, true);
-    uint64_t erst_addr = (uintptr_t)kalloc(mem_page, MAX_ERST_AMOUNT * sizeof(erst_entry), ALIGN_64B, true, true);
+    uint64_t ev_ring = (uintptr_t)dma_alloc_coherent(MAX_TRB_AMOUNT * sizeof(trb));
+    uint64_t erst_addr = (uintptr_t)dma_alloc_coherent(MAX_ERST_AMOUNT * sizeof(erst_entry));
     erst_entry* erst = (erst_entry*)erst_addr;
 
     erst->ring_base = ev_ring;
@@ -376,10 +378,10 @@ bool XHCIDriver::setup_device(uint8_t address, uint16_t port){
 
     transfer_ring->cycle_bit = 1;
 
-    xhci_input_context *ctx = (xhci_input_context*)kalloc(mem_page, sizeof(xhci_input_context), ALIGN_64B, true, true);
+    xhci_input_context *ctx = (xhci_input_context*)dma_alloc_coherent(sizeof(xhci_input_context));
     kprintfv("[xHCI] Allocating input context at %x", (uintptr_t)ctx);
     context_map[address << 8] = ctx;
-    void* output_ctx = (void*)kalloc(mem_page, 0x1000, ALIGN_64B, true, true);
+    void* output_ctx = (void*)dma_alloc_coherent(0x1000);
     kprintfv("[xHCI] Allocating output for context at %x", (uintptr_t)output_ctx);
     
     ctx->control_context.add_flags = 0b11;
@@ -394,7 +396,7 @@ bool XHCIDriver::setup_device(uint8_t address, uint16_t port){
     ctx->device_context.endpoints[0].endpoint_f1.error_count = 3;
     ctx->device_context.endpoints[0].endpoint_f1.max_packet_size = packet_size(ctx->device_context.slot_f0.speed);
     
-    transfer_ring->ring = (trb*)kalloc(mem_page, MAX_TRB_AMOUNT * sizeof(trb), ALIGN_64B, true, true);
+    transfer_ring->ring = (trb*)dma_alloc_coherent(MAX_TRB_AMOUNT * sizeof(trb));
     kprintfv("Transfer ring at %x %i",(uintptr_t)transfer_ring->ring, address << 8);
     make_ring_link(transfer_ring->ring, transfer_ring->cycle_bit);
 
@@ -448,7 +450,16 @@ bool XHCIDriver::request_sized_descriptor(uint8_t address, uint8_t endpoint, uin
         transfer_ring->index = 0;
     }
 
-    return AWAIT(0, {ring_doorbell(address, 1);}, TRB_TYPE_TRANSFER);//TODO: Devices can respond with an error to any of the 3 stages
+    //Callers may pass cacheable buffers, some on the stack
+    if (descriptor_size > 0)
+        dma_sync_for_device(out_descriptor, descriptor_size);
+
+    bool result = AWAIT(0, {ring_doorbell(address, 1);}, TRB_TYPE_TRANSFER);//TODO: Devices can respond with an error to any of the 3 stages
+
+    if (descriptor_size > 0 && is_in)
+        dma_sync_for_cpu(out_descriptor, descriptor_size);
+
+    return result;
 }
 
 uint8_t XHCIDriver::address_device(uint8_t address){
@@ -518,7 +529,7 @@ bool XHCIDriver::configure_endpoint(uint8_t address, usb_endpoint_descriptor *en
     
     xhci_ring *ep_ring = &endpoint_map[address << 8 | ep_num];
     
-    ep_ring->ring = (trb*)kalloc(mem_page, MAX_TRB_AMOUNT * sizeof(trb), ALIGN_64B, true, true);
+    ep_ring->ring = (trb*)dma_alloc_coherent(MAX_TRB_AMOUNT * sizeof(trb));
     ep_ring->cycle_bit = 1;
     make_ring_link(ep_ring->ring, ep_ring->cycle_bit);
     ctx->device_context.endpoints[ep_num-1].endpoint_f23.dcs = ep_ring->cycle_bit;
@@ -17,8 +17,20 @@
 #include "filesystem/filesystem.h"
 #include "dev/module_loader.h" 
 #include "audio/audio.h"
+#include "hw/smp.h"
+#include "exceptions/timer.h"
+#include "std/memfunctions.h"
+#ifdef BENCH
+#include "kernel_processes/bench/bench.h"
+#endif
 
 void kernel_main() {
+    //Every access is to Device memory until mmu_init, drivers included
+    mem_device_access = true;
+
+#ifdef BENCH
+    uint64_t boot_start = timer_now();
+#endif
 
     detect_hardware();
     
@@ -32,6 +44,10 @@ void kernel_main() {
     load_module(&console_module);
     kprint("UART output enabled");
 
+#ifdef DEBUG
+    page_allocator_selftest();
+#endif
+
     // mmu_enable_verbose();
     mmu_alloc();
 
@@ -72,6 +88,8 @@ void kernel_main() {
     mmu_init();
     kprint("MMU Mapped");
 
+    timer_vdso_init();
+
     if (!init_boot_filesystem())
         panic("Filesystem initialization failure");
 
@@ -83,7 +101,17 @@ void kernel_main() {
 
     init_bootprocess();
 
+#ifdef BENCH
+    launch_bench_process();
+#endif
+
     console_module.write(0, "Hello from module", 0, 0);
+
+    smp_init();
+
+#ifdef BENCH
+    bench_report("boot.kernel_main", bench_ticks_to_ns(timer_now() - boot_start) / 1000000, "ms");
+#endif
     
     kprint("Starting scheduler");
     
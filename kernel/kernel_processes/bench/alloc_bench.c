@@ -0,0 +1,57 @@
+#include "bench.h"
+#include "exceptions/timer.h"
+#include "memory/page_allocator.h"
+#include "memory/slab.h"
+#include "process/scheduler.h"
+
+#define ALLOC_BENCH_ITERATIONS 10000
+#define ALLOC_BENCH_LIVE 64
+#define PALLOC_BENCH_ITERATIONS 2000
+
+static kmem_cache bench_cache = KMEM_CACHE("bench", 256, ALIGN_64B, false);
+
+//Average alloc/free pair through the kalloc size classes with a working set of live blocks, then through a slab cache,
+//then for whole page runs
+void bench_alloc(){
+    void *heap = (void*)get_current_heap();
+    void *live[ALLOC_BENCH_LIVE] = {};
+    static const uint64_t sizes[] = { 16, 48, 100, 256, 1000 };
+
+    uint64_t start = timer_now();
+    for (int i = 0; i < ALLOC_BENCH_ITERATIONS; i++){
+        int slot = i % ALLOC_BENCH_LIVE;
+        uint64_t size = sizes[i % 5];
+        if (live[slot]) kfree(live[slot], sizes[(i - ALLOC_BENCH_LIVE) % 5]);
+        live[slot] = kalloc(heap, size, ALIGN_16B, true, false);
+    }
+    uint64_t kalloc_ticks = timer_now() - start;
+    for (int i = 0; i < ALLOC_BENCH_LIVE; i++){
+        int last = ALLOC_BENCH_ITERATIONS - ALLOC_BENCH_LIVE + i;
+        kfree(live[last % ALLOC_BENCH_LIVE], sizes[last % 5]);
+        live[last % ALLOC_BENCH_LIVE] = 0;
+    }
+
+    start = timer_now();
+    for (int i = 0; i < ALLOC_BENCH_ITERATIONS; i++){
+        int slot = i % ALLOC_BENCH_LIVE;
+        if (live[slot]) kmem_cache_free(&bench_cache, live[slot]);
+        live[slot] = kmem_cache_alloc(&bench_cache);
+    }
+    uint64_t slab_ticks = timer_now() - start;
+    for (int i = 0; i < ALLOC_BENCH_LIVE; i++)
+        kmem_cache_free(&bench_cache, live[i]);
+
+    bench_report("alloc.kalloc", bench_ticks_to_ns(kalloc_ticks) / ALLOC_BENCH_ITERATIONS, "ns");
+    bench_report("alloc.slab", bench_ticks_to_ns(slab_ticks) / ALLOC_BENCH_ITERATIONS, "ns");
+
+    //Page runs straight from the buddy allocator, one page and a 16 page run
+    static const uint64_t run_sizes[] = { PAGE_SIZE, PAGE_SIZE * 16 };
+    for (int r = 0; r < 2; r++){
+        start = timer_now();
+        for (int i = 0; i < PALLOC_BENCH_ITERATIONS; i++)
+            pfree(palloc(run_sizes[r], true, false, false), run_sizes[r]);
+        uint64_t palloc_ticks = timer_now() - start;
+        bench_report_n("alloc.palloc", run_sizes[r], bench_ticks_to_ns(palloc_ticks) / PALLOC_BENCH_ITERATIONS, "ns");
+    }
+    kmem_print_stats();
+}
@@ -0,0 +1,42 @@
+#include "bench.h"
+#include "../kprocess_loader.h"
+#include "console/kio.h"
+#include "process/scheduler.h"
+
+void bench_report(const char *name, uint64_t value, const char *unit){
+    kprintf("[bench] %s %i %s", (uintptr_t)name, value, (uintptr_t)unit);
+}
+
+void bench_report_n(const char *name, uint64_t n, uint64_t value, const char *unit){
+    kprintf("[bench] %s.%i %i %s", (uintptr_t)name, n, value, (uintptr_t)unit);
+}
+
+uint64_t bench_ticks_to_ns(uint64_t ticks){
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+    return (ticks * 1000000000) / freq;
+}
+
+void run_benchmarks(){
+    kprint("[bench] start");
+    bench_scheduler();
+    bench_time();
+    bench_syscalls();
+    bench_ring();
+    bench_alloc();
+    bench_zeroing();
+    bench_memory();
+    bench_mmu();
+    bench_disk();
+    bench_fs();
+    bench_graphics();
+    bench_udp_loopback();
+    bench_process_cycles();
+    bench_user_programs();
+    kprint("[bench] end");
+    stop_current_process();
+}
+
+process_t* launch_bench_process(){
+    return create_kernel_process("bench", run_benchmarks);
+}
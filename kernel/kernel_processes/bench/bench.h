@@ -0,0 +1,35 @@
+#pragma once
+
+#include "process/process.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+//Results are printed as "[bench] <name> <value> <unit>" so they can be parsed from the serial log
+void bench_report(const char *name, uint64_t value, const char *unit);
+void bench_report_n(const char *name, uint64_t n, uint64_t value, const char *unit);
+uint64_t bench_ticks_to_ns(uint64_t ticks);
+
+void bench_scheduler();
+void bench_time();
+void bench_syscalls();
+void bench_ring();
+void bench_alloc();
+void bench_zeroing();
+void bench_memory();
+void bench_mmu();
+void bench_disk();
+void bench_fs();
+void bench_graphics();
+void bench_udp_loopback();
+void bench_process_cycles();
+void bench_user_programs();
+
+process_t* launch_bench_process();
+
+#ifdef __cplusplus
+}
+#endif
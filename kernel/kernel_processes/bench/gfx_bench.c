@@ -0,0 +1,41 @@
+#include "bench.h"
+#include "console/kio.h"
+#include "exceptions/timer.h"
+#include "graph/graphics.h"
+
+#define GFX_BENCH_FRAMES 50
+#define GFX_BENCH_RECTS 2000
+
+//Full screen clears with and without a flush to the device, and small rect fills. The screen is left as it was
+//drawn, whatever owns it redraws on its next frame
+void bench_graphics(){
+    if (!gpu_ready()){
+        kprint("[bench] no gpu");
+        return;
+    }
+    gpu_size screen = gpu_get_screen_size();
+
+    uint64_t start = timer_now();
+    for (int i = 0; i < GFX_BENCH_FRAMES; i++)
+        gpu_clear(0xFF000000 | (i * 0x050505));
+    uint64_t ns = bench_ticks_to_ns(timer_now() - start);
+    bench_report("gfx.clear", ns / GFX_BENCH_FRAMES / 1000, "us");
+
+    start = timer_now();
+    for (int i = 0; i < GFX_BENCH_FRAMES; i++){
+        gpu_clear(0xFF000000 | (i * 0x050505));
+        gpu_flush();
+    }
+    ns = bench_ticks_to_ns(timer_now() - start);
+    if (ns)
+        bench_report("gfx.clear_flush", (uint64_t)GFX_BENCH_FRAMES * 1000000000 / ns, "fps");
+
+    start = timer_now();
+    for (int i = 0; i < GFX_BENCH_RECTS; i++){
+        gpu_rect r = { { (i * 37) % (screen.width - 100), (i * 23) % (screen.height - 50) }, { 100, 50 } };
+        gpu_fill_rect(r, 0xFF00FF00);
+    }
+    ns = bench_ticks_to_ns(timer_now() - start);
+    bench_report("gfx.fill_rect_100x50", ns / GFX_BENCH_RECTS, "ns");
+    gpu_flush();
+}
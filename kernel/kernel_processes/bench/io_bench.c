@@ -0,0 +1,72 @@
+#include "bench.h"
+#include "console/kio.h"
+#include "exceptions/timer.h"
+#include "filesystem/disk.h"
+#include "memory/page_allocator.h"
+#include "process/scheduler.h"
+#include "dev/module_loader.h"
+#include "math/rng.h"
+
+#define DISK_BENCH_SECTOR 512
+//Reads stay inside the first 32MB, the image is always at least 64MB
+#define DISK_BENCH_SPAN_SECTORS 0x10000
+#define DISK_BENCH_SEQ_SECTORS 128
+#define DISK_BENCH_RANDOM_SECTORS 8
+#define DISK_BENCH_RANDOM_READS 1000
+#define FS_BENCH_FILE "/boot/redos/user/heapbench.elf"
+//The driver keeps every opened file in a table of 128, so this stays small
+#define FS_BENCH_ROUNDS 8
+
+//Sequential 64KB reads across the span, then 4KB reads at random sectors. The seed is fixed so runs compare
+void bench_disk(){
+    void *heap = (void*)get_current_heap();
+    uint64_t seq_size = DISK_BENCH_SEQ_SECTORS * DISK_BENCH_SECTOR;
+    void *buffer = kalloc_uninit(heap, seq_size, ALIGN_64B, true, false);
+
+    uint64_t start = timer_now();
+    for (uint32_t sector = 0; sector < DISK_BENCH_SPAN_SECTORS; sector += DISK_BENCH_SEQ_SECTORS)
+        disk_read(buffer, sector, DISK_BENCH_SEQ_SECTORS);
+    uint64_t ns = bench_ticks_to_ns(timer_now() - start);
+    uint64_t reads = DISK_BENCH_SPAN_SECTORS / DISK_BENCH_SEQ_SECTORS;
+    if (ns){
+        bench_report("disk.seq_read", (uint64_t)DISK_BENCH_SPAN_SECTORS * DISK_BENCH_SECTOR * 1000 / ns, "MB/s");
+        bench_report("disk.seq_read_iops", reads * 1000000000 / ns, "IOPS");
+    }
+
+    rng_t rng;
+    rng_seed(&rng, 0x5EED);
+    start = timer_now();
+    for (int i = 0; i < DISK_BENCH_RANDOM_READS; i++){
+        uint32_t sector = rng_between32(&rng, 0, DISK_BENCH_SPAN_SECTORS / DISK_BENCH_RANDOM_SECTORS) * DISK_BENCH_RANDOM_SECTORS;
+        disk_read(buffer, sector, DISK_BENCH_RANDOM_SECTORS);
+    }
+    ns = bench_ticks_to_ns(timer_now() - start);
+    if (ns)
+        bench_report("disk.random_read_iops", (uint64_t)DISK_BENCH_RANDOM_READS * 1000000000 / ns, "IOPS");
+
+    kfree(buffer, seq_size);
+}
+
+//Whole file reads through the FAT32 driver. Opening is what walks the directory and reads the clusters, so it's
+//part of each round
+void bench_fs(){
+    const char *path = FS_BENCH_FILE;
+    driver_module *mod = get_module(&path);
+    file fd = {0,0};
+    if (!mod || mod->open(path, &fd) != FS_RESULT_SUCCESS || !fd.size){
+        kprintf("[bench] could not open %s", (uintptr_t)FS_BENCH_FILE);
+        return;
+    }
+
+    void *heap = (void*)get_current_heap();
+    char *buffer = kalloc_uninit(heap, fd.size, ALIGN_64B, true, false);
+    uint64_t start = timer_now();
+    for (int i = 0; i < FS_BENCH_ROUNDS; i++){
+        mod->open(path, &fd);
+        mod->read(&fd, buffer, fd.size, 0);
+    }
+    uint64_t ns = bench_ticks_to_ns(timer_now() - start);
+    if (ns)
+        bench_report("fs.fat32_read", (uint64_t)FS_BENCH_ROUNDS * fd.size * 1000 / ns, "MB/s");
+    kfree(buffer, fd.size);
+}
@@ -0,0 +1,52 @@
+#include "bench.h"
+#include "exceptions/timer.h"
+#include "memory/page_allocator.h"
+#include "std/memfunctions.h"
+
+#define MEM_BENCH_MAX 0x100000
+//Each size is repeated until about this many bytes have gone through, so small sizes still time well
+#define MEM_BENCH_BYTES 0x1000000
+
+typedef enum { MEM_COPY, MEM_COPY_UNALIGNED, MEM_SET, MEM_MOVE, MEM_CMP } mem_bench_op;
+
+static uint64_t mem_bench_run(mem_bench_op op, uint8_t *a, uint8_t *b, uint64_t size){
+    uint64_t rounds = MEM_BENCH_BYTES / size;
+    volatile int sink = 0;
+    uint64_t start = timer_now();
+    for (uint64_t i = 0; i < rounds; i++){
+        switch (op){
+            case MEM_COPY: memcpy(a, b, size); break;
+            case MEM_COPY_UNALIGNED: memcpy(a + 3, b + 1, size); break;
+            case MEM_SET: memset(a, i, size); break;
+            //Overlapping by less than the size, so the backwards path runs
+            case MEM_MOVE: memmove(a + 8, a, size); break;
+            case MEM_CMP: sink += memcmp(a, b, size); break;
+        }
+    }
+    uint64_t ns = bench_ticks_to_ns(timer_now() - start);
+    (void)sink;
+    if (!ns) return 0;
+    return (rounds * size * 1000) / ns;
+}
+
+//Throughput of the mem functions from 16 bytes to 1MB, in MB/s
+void bench_memory(){
+    //The extra page leaves room for the unaligned and overlapping variants
+    uint8_t *a = palloc(MEM_BENCH_MAX + PAGE_SIZE, true, false, false);
+    uint8_t *b = palloc(MEM_BENCH_MAX + PAGE_SIZE, true, false, false);
+    if (!a || !b) return;
+
+    static const char *names[] = { "mem.memcpy", "mem.memcpy_unaligned", "mem.memset", "mem.memmove", "mem.memcmp" };
+    for (uint64_t size = 16; size <= MEM_BENCH_MAX; size <<= 2){
+        memset(a, 0x5A, size + 16);
+        memset(b, 0x5A, size + 16);
+        for (int op = MEM_COPY; op <= MEM_CMP; op++){
+            //memcmp has to see equal buffers to walk the whole size
+            if (op == MEM_CMP) memcpy(a, b, size);
+            bench_report_n(names[op], size, mem_bench_run(op, a, b, size), "MB/s");
+        }
+    }
+
+    pfree(a, MEM_BENCH_MAX + PAGE_SIZE);
+    pfree(b, MEM_BENCH_MAX + PAGE_SIZE);
+}
@@ -0,0 +1,58 @@
+#include "bench.h"
+#include "exceptions/timer.h"
+#include "memory/page_allocator.h"
+#include "memory/mmu.h"
+
+#define SWEEP_WIDTH 1920
+#define SWEEP_HEIGHT 1080
+#define SWEEP_COLUMNS 64
+
+//Draws vertical lines down a 1080p framebuffer sized buffer. Each row is on a different page every other
+//pixel, so the cost is dominated by TLB misses
+static uint64_t sweep_columns(volatile uint32_t *fb){
+    uint64_t start = timer_now();
+    for (uint32_t x = 0; x < SWEEP_COLUMNS; x++)
+        for (uint32_t y = 0; y < SWEEP_HEIGHT; y++)
+            fb[(y * SWEEP_WIDTH) + x] = x;
+    return timer_now() - start;
+}
+
+//Kernel allocations reuse the blocks the linear map already has. User allocations come from the paged zone
+//and rewrite their 4kb pages, with a flush
+void bench_mmu(){
+    uint64_t size = SWEEP_WIDTH * SWEEP_HEIGHT * sizeof(uint32_t);
+    uint64_t tables, splits;
+
+    mmu_table_stats(&tables, &splits);
+    uint64_t tables_before = tables;
+    void *linear = palloc(size, true, false, true);
+    mmu_table_stats(&tables, &splits);
+    uint64_t linear_tables = tables - tables_before;
+
+    tables_before = tables;
+    void *paged = palloc(size, false, false, true);
+    mmu_table_stats(&tables, &splits);
+    uint64_t paged_tables = tables - tables_before;
+
+    if (!linear || !paged){
+        if (linear) pfree(linear, size);
+        if (paged) pfree(paged, size);
+        return;
+    }
+
+    //First pass warms the caches, the second is measured
+    sweep_columns((volatile uint32_t*)linear);
+    uint64_t linear_ticks = sweep_columns((volatile uint32_t*)linear);
+    sweep_columns((volatile uint32_t*)paged);
+    uint64_t paged_ticks = sweep_columns((volatile uint32_t*)paged);
+
+    pfree(linear, size);
+    pfree(paged, size);
+
+    bench_report("mmu.fb_sweep_linear", bench_ticks_to_ns(linear_ticks) / SWEEP_COLUMNS, "ns");
+    bench_report("mmu.fb_sweep_4kb", bench_ticks_to_ns(paged_ticks) / SWEEP_COLUMNS, "ns");
+    bench_report("mmu.linear_alloc_tables", linear_tables, "pages");
+    bench_report("mmu.4kb_alloc_tables", paged_tables, "pages");
+    bench_report("mmu.table_pages", tables, "pages");
+    bench_report("mmu.block_splits", splits, "blocks");
+}
@@ -0,0 +1,40 @@
+#include "bench.h"
+#include "console/kio.h"
+#include "exceptions/timer.h"
+#include "networking/network.h"
+#include "process/scheduler.h"
+
+#define NET_BENCH_PORT 9099
+#define NET_BENCH_PACKETS 5000
+#define NET_BENCH_PAYLOAD 512
+
+//UDP to our own port over loopback, each packet read back before the next is sent. Covers building the frame,
+//the receive path and the copy out to the reader
+void bench_udp_loopback(){
+    uint16_t pid = get_current_proc_pid();
+    if (!network_bind_port(NET_BENCH_PORT, pid)){
+        kprint("[bench] could not bind the loopback port");
+        return;
+    }
+
+    network_connection_ctx destination = { .port = NET_BENCH_PORT, .ip = (127 << 24) | 1 };
+    uint8_t payload[NET_BENCH_PAYLOAD] = {0};
+    process_t *proc = get_current_proc();
+    uint64_t received = 0;
+
+    uint64_t start = timer_now();
+    for (int i = 0; i < NET_BENCH_PACKETS; i++){
+        network_send_packet(UDP, NET_BENCH_PORT, &destination, payload, NET_BENCH_PAYLOAD);
+        sizedptr packet;
+        if (network_read_packet(&packet, pid)){
+            received++;
+            process_free(proc, (void*)packet.ptr, packet.size);
+        }
+    }
+    uint64_t ns = bench_ticks_to_ns(timer_now() - start);
+    network_unbind_port(NET_BENCH_PORT, pid);
+
+    if (ns)
+        bench_report("net.udp_loopback", received * 1000000000 / ns, "pps");
+    bench_report("net.udp_loopback_lost", NET_BENCH_PACKETS - received, "packets");
+}
@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "../kprocess_loader.h"
+#include "process/loading/process_loader.h"
+#include "process/scheduler.h"
+#include "memory/page_allocator.h"
+#include "memory/mmu.h"
+#include "syscalls/syscalls.h"
+#include "exceptions/timer.h"
+
+#define PROC_BENCH_CYCLES 1000
+
+//Grows the stack past its committed page, then halts
+static const uint32_t cycle_user_code[] = {
+    0xD1400BFF,//sub sp, sp, #2, lsl #12
+    0xF90003FF,//str xzr, [sp]
+    0xD4000421,//svc #33
+};
+
+static void cycle_kernel_main(){
+    volatile uint8_t deep[0x2000];
+    deep[0] = 1;
+    (void)deep;
+    stop_current_process();
+}
+
+static process_t* cycle_user(){
+    process_segment code = {
+        .va = USER_CODE_BASE,
+        .content = (void*)cycle_user_code,
+        .size = sizeof(cycle_user_code),
+        .mem_size = sizeof(cycle_user_code),
+    };
+    return create_process("bench_cycle", &code, 1, USER_CODE_BASE);
+}
+
+static process_t* cycle_kernel(){
+    return create_kernel_process("bench_cycle", cycle_kernel_main);
+}
+
+//Pages the idle loop moved into the zero pool are still free, just zeroed ahead of time
+static uint64_t available_pages(){
+    uint64_t pooled, hits, misses;
+    zero_pool_stats(&pooled, &hits, &misses);
+    return palloc_free_pages() + pooled;
+}
+
+typedef struct {
+    uint64_t leaked_pages;
+    uint64_t leaked_tables;
+    uint64_t cycle_ns;
+} cycle_result;
+
+static cycle_result run_cycles(process_t* (*launch)()){
+    //The first process through pays for tables and process slots that later ones reuse
+    process_t *proc = launch();
+    while (proc && proc->state != STOPPED) sleep(1);
+
+    uint64_t tables, splits;
+    mmu_table_stats(&tables, &splits);
+    uint64_t tables_before = tables;
+    uint64_t pages_before = available_pages();
+
+    uint64_t start = timer_now();
+    for (int i = 0; i < PROC_BENCH_CYCLES; i++){
+        proc = launch();
+        while (proc && proc->state != STOPPED) sleep(1);
+    }
+    uint64_t ticks = timer_now() - start;
+
+    mmu_table_stats(&tables, &splits);
+    uint64_t pages_after = available_pages();
+    return (cycle_result){
+        .leaked_pages = pages_before > pages_after ? pages_before - pages_after : 0,
+        .leaked_tables = tables > tables_before ? tables - tables_before : 0,
+        .cycle_ns = bench_ticks_to_ns(ticks) / PROC_BENCH_CYCLES,
+    };
+}
+
+//Launches and stops processes that each commit a little stack. Nothing they held should stay allocated
+void bench_process_cycles(){
+    cycle_result user = run_cycles(cycle_user);
+    bench_report("proc.user_leaked_pages", user.leaked_pages, "pages");
+    bench_report("proc.user_leaked_tables", user.leaked_tables, "tables");
+    bench_report("proc.user_cycle", user.cycle_ns, "ns");
+
+    cycle_result kernel = run_cycles(cycle_kernel);
+    bench_report("proc.kernel_leaked_pages", kernel.leaked_pages, "pages");
+    bench_report("proc.kernel_leaked_tables", kernel.leaked_tables, "tables");
+    bench_report("proc.kernel_cycle", kernel.cycle_ns, "ns");
+}
@@ -0,0 +1,37 @@
+#include "bench.h"
+#include "exceptions/timer.h"
+#include "syscalls/syscalls.h"
+#include "syscalls/syscall_ring.h"
+
+#define RING_BENCH_ROUNDS 1000
+#define RING_BENCH_READ_KEY 5
+
+//A batch of RING_ENTRIES read_keys issued one svc each against the same batch submitted through one ring_enter
+void bench_ring(){
+    syscall_ring *ring = ring_setup();
+    if (!ring) return;
+    volatile uint64_t sink = 0;
+    keypress kp;
+
+    uint64_t start = timer_now();
+    for (int r = 0; r < RING_BENCH_ROUNDS; r++)
+        for (int i = 0; i < RING_ENTRIES; i++)
+            sink += read_key(&kp);
+    uint64_t direct_ticks = timer_now() - start;
+
+    start = timer_now();
+    for (int r = 0; r < RING_BENCH_ROUNDS; r++){
+        for (int i = 0; i < RING_ENTRIES; i++)
+            ring_push(ring, RING_BENCH_READ_KEY, i, (uintptr_t)&kp, 0, 0, 0, 0);
+        ring_enter();
+        ring_cqe *cqe;
+        while ((cqe = ring_peek_cqe(ring))){
+            sink += cqe->result;
+            ring_cqe_seen(ring);
+        }
+    }
+    uint64_t ring_ticks = timer_now() - start;
+
+    bench_report("ring.direct_batch", bench_ticks_to_ns(direct_ticks) / RING_BENCH_ROUNDS, "ns");
+    bench_report("ring.ring_batch", bench_ticks_to_ns(ring_ticks) / RING_BENCH_ROUNDS, "ns");
+}
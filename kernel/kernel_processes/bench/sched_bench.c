@@ -0,0 +1,43 @@
+#include "bench.h"
+#include "../kprocess_loader.h"
+#include "process/scheduler.h"
+#include "exceptions/irq.h"
+#include "syscalls/syscalls.h"
+
+#define SCHED_BENCH_WINDOW_MSEC 500
+
+static volatile bool spin_stop;
+static volatile uint16_t spinners_alive;
+
+void bench_spinner(){
+    while (!spin_stop);
+    disable_interrupt();
+    spinners_alive--;
+    stop_current_process();
+}
+
+//Runs CPU-bound processes for a fixed window and reports the average cost of picking the next process and of the whole switch.
+//With the priority run queues both numbers should stay flat as the process count grows.
+void bench_scheduler(){
+    uint16_t counts[] = { 1, 2, 4, 8, 16, 64, 256 };
+    for (uint32_t c = 0; c < sizeof(counts)/sizeof(counts[0]); c++){
+        uint16_t n = counts[c];
+        spin_stop = false;
+        spinners_alive = n;
+        for (uint16_t i = 0; i < n; i++)
+            create_kernel_process("bench_spin", bench_spinner);
+
+        scheduler_stats before = get_scheduler_stats();
+        sleep(SCHED_BENCH_WINDOW_MSEC);
+        scheduler_stats after = get_scheduler_stats();
+
+        spin_stop = true;
+        while (spinners_alive) sleep(1);
+
+        uint64_t switches = after.switches - before.switches;
+        if (!switches) continue;
+        bench_report_n("sched.pick_next_ns", n, bench_ticks_to_ns(after.pick_ticks - before.pick_ticks) / switches, "ns");
+        bench_report_n("sched.switch_ns", n, bench_ticks_to_ns(after.switch_ticks - before.switch_ticks) / switches, "ns");
+        bench_report_n("sched.switches", n, switches, "count");
+    }
+}
@@ -0,0 +1,24 @@
+#include "bench.h"
+#include "exceptions/timer.h"
+#include "syscalls/syscalls.h"
+
+#define SYSCALL_BENCH_ITERATIONS 10000
+
+//Round trip of a leaf syscall, which skips the context save, against read_key, which takes the full save/restore path
+void bench_syscalls(){
+    volatile uint64_t sink = 0;
+    keypress kp;
+
+    uint64_t start = timer_now();
+    for (int i = 0; i < SYSCALL_BENCH_ITERATIONS; i++)
+        sink += get_pid();
+    uint64_t fast_ticks = timer_now() - start;
+
+    start = timer_now();
+    for (int i = 0; i < SYSCALL_BENCH_ITERATIONS; i++)
+        sink += read_key(&kp);
+    uint64_t full_ticks = timer_now() - start;
+
+    bench_report("syscall.fast_path", bench_ticks_to_ns(fast_ticks) / SYSCALL_BENCH_ITERATIONS, "ns");
+    bench_report("syscall.full_path", bench_ticks_to_ns(full_ticks) / SYSCALL_BENCH_ITERATIONS, "ns");
+}
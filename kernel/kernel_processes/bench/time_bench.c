@@ -0,0 +1,30 @@
+#include "bench.h"
+#include "exceptions/timer.h"
+#include "syscalls/syscalls.h"
+#include "syscalls/vdso.h"
+
+#define TIME_BENCH_ITERATIONS 10000
+
+//Average cost of reading the time through syscall 40 against reading it through the vDSO page
+void bench_time(){
+    volatile uint64_t sink = 0;
+
+    uint64_t start = timer_now();
+    for (int i = 0; i < TIME_BENCH_ITERATIONS; i++)
+        sink += get_time_syscall();
+    uint64_t syscall_ticks = timer_now() - start;
+
+    start = timer_now();
+    for (int i = 0; i < TIME_BENCH_ITERATIONS; i++)
+        sink += get_time();
+    uint64_t vdso_ticks = timer_now() - start;
+
+    start = timer_now();
+    for (int i = 0; i < TIME_BENCH_ITERATIONS; i++)
+        sink += vdso_time_ns();
+    uint64_t vdso_ns_ticks = timer_now() - start;
+
+    bench_report("time.get_time_syscall", bench_ticks_to_ns(syscall_ticks) / TIME_BENCH_ITERATIONS, "ns");
+    bench_report("time.get_time_vdso", bench_ticks_to_ns(vdso_ticks) / TIME_BENCH_ITERATIONS, "ns");
+    bench_report("time.vdso_time_ns", bench_ticks_to_ns(vdso_ns_ticks) / TIME_BENCH_ITERATIONS, "ns");
+}
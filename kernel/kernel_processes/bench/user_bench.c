@@ -0,0 +1,22 @@
+#include "bench.h"
+#include "console/kio.h"
+#include "filesystem/filesystem.h"
+#include "process/loading/elf_file.h"
+#include "syscalls/syscalls.h"
+
+//User programs that print their own [bench] lines. Each runs to completion before the next one starts
+static const char *bench_programs[][2] = {
+    { "heapbench", "/boot/redos/user/heapbench.elf" },
+};
+
+void bench_user_programs(){
+    for (uint32_t i = 0; i < sizeof(bench_programs)/sizeof(bench_programs[0]); i++){
+        void *file = read_file(bench_programs[i][1], 0);
+        process_t *proc = file ? load_elf_file(bench_programs[i][0], file) : 0;
+        if (!proc){
+            kprintf("[bench] could not launch %s", (uintptr_t)bench_programs[i][1]);
+            continue;
+        }
+        while (proc->state != STOPPED) sleep(10);
+    }
+}
@@ -0,0 +1,58 @@
+#include "bench.h"
+#include "exceptions/timer.h"
+#include "memory/page_allocator.h"
+#include "process/scheduler.h"
+#include "syscalls/syscalls.h"
+#include "std/memfunctions.h"
+
+#define ZERO_BENCH_ITERATIONS 2000
+#define ZERO_BENCH_PAGES 32
+
+//Cost of zeroing on allocation against handing out uninitialized blocks, and of a zeroed page taken from
+//the idle loop's pool against one zeroed on the spot
+void bench_zeroing(){
+    void *heap = (void*)get_current_heap();
+
+    uint64_t start = timer_now();
+    for (int i = 0; i < ZERO_BENCH_ITERATIONS; i++)
+        kfree(kalloc_zeroed(heap, KALLOC_MAX_CLASS, ALIGN_16B, true, false), KALLOC_MAX_CLASS);
+    uint64_t zeroed_ticks = timer_now() - start;
+
+    start = timer_now();
+    for (int i = 0; i < ZERO_BENCH_ITERATIONS; i++)
+        kfree(kalloc_uninit(heap, KALLOC_MAX_CLASS, ALIGN_16B, true, false), KALLOC_MAX_CLASS);
+    uint64_t uninit_ticks = timer_now() - start;
+
+    bench_report("zero.kalloc_zeroed_2k", bench_ticks_to_ns(zeroed_ticks) / ZERO_BENCH_ITERATIONS, "ns");
+    bench_report("zero.kalloc_uninit_2k", bench_ticks_to_ns(uninit_ticks) / ZERO_BENCH_ITERATIONS, "ns");
+
+    //Give the idle loop a chance to fill the pool before drawing from it
+    sleep(100);
+
+    void *pages[ZERO_BENCH_PAGES];
+    uint64_t pooled, hits, misses;
+    zero_pool_stats(&pooled, &hits, &misses);
+    uint64_t hits_before = hits;
+
+    start = timer_now();
+    for (int i = 0; i < ZERO_BENCH_PAGES; i++)
+        pages[i] = kalloc_zeroed(heap, PAGE_SIZE, ALIGN_4KB, true, false);
+    uint64_t pool_ticks = timer_now() - start;
+    zero_pool_stats(&pooled, &hits, &misses);
+    uint64_t pool_hits = hits - hits_before;
+    for (int i = 0; i < ZERO_BENCH_PAGES; i++)
+        kfree(pages[i], 0);
+
+    start = timer_now();
+    for (int i = 0; i < ZERO_BENCH_PAGES; i++){
+        pages[i] = kalloc_uninit(heap, PAGE_SIZE, ALIGN_4KB, true, false);
+        memset(pages[i], 0, PAGE_SIZE);
+    }
+    uint64_t memset_ticks = timer_now() - start;
+    for (int i = 0; i < ZERO_BENCH_PAGES; i++)
+        kfree(pages[i], 0);
+
+    bench_report("zero.page_from_pool", bench_ticks_to_ns(pool_ticks) / ZERO_BENCH_PAGES, "ns");
+    bench_report("zero.page_pool_hits", pool_hits, "pages");
+    bench_report("zero.page_memset", bench_ticks_to_ns(memset_ticks) / ZERO_BENCH_PAGES, "ns");
+}
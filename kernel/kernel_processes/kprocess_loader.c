@@ -3,6 +3,7 @@
 #include "process/scheduler.h"
 #include "memory/page_allocator.h"
 #include "exceptions/irq.h"
+#include "process/demand_paging.h"
 
 process_t *create_kernel_process(const char *name, void (*func)()){
 
@@ -12,19 +13,14 @@ process_t *create_kernel_process(const char *name, void (*func)()){
 
     name_process(proc, name);
 
-    uint64_t stack_size = 0x1000;
+    //Only the top page of the stack is committed, the rest of its slot is mapped as it grows
+    if (!demand_stack_create(proc)) return 0;
+    kprintf("Stack size %x. Top %x", proc->stack_size, proc->stack);
 
-    uintptr_t stack = (uintptr_t)palloc(stack_size, true, false, false);
-    kprintf("Stack size %x. Start %x", stack_size,stack);
-    if (!stack) return 0;
-
-    uintptr_t heap = (uintptr_t)palloc(stack_size, true, false, false);
+    uintptr_t heap = (uintptr_t)palloc(PAGE_SIZE, true, false, false);
     kprintf("Heap %x", heap);
     if (!heap) return 0;
 
-    proc->stack = (stack + stack_size);
-    proc->stack_size = stack_size;
-
     proc->heap = heap;
 
     proc->sp = proc->stack;
@@ -32,7 +28,8 @@ process_t *create_kernel_process(const char *name, void (*func)()){
     proc->pc = (uintptr_t)func;
     kprintf("Kernel process %s allocated with address at %x, stack at %x, heap at %x", (uintptr_t)name, proc->pc, proc->sp, proc->heap);
     proc->spsr = 0x205;
-    proc->state = READY;
+    proc->priority = PRIORITY_KERNEL;
+    enqueue_process(proc);
 
     enable_interrupt();
     
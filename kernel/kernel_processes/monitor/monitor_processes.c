@@ -39,9 +39,8 @@ uint64_t calc_heap(uintptr_t ptr){
 
 __attribute__((section(".text.kcoreprocesses")))
 void print_process_info(){
-    process_t *processes = get_all_processes();
-    for (int i = 0; i < MAX_PROCS; i++){
-        process_t *proc = &processes[i];
+    for (uint32_t i = 0; i < process_table_size(); i++){
+        process_t *proc = get_process_at(i);
         if (proc->id != 0 && proc->state != STOPPED){
             printf("Process [%i]: %s [pid = %i | status = %s]",i,(uintptr_t)proc->name,proc->id,(uintptr_t)parse_proc_state(proc->state));
             printf("Stack: %x (%x). SP: %x",proc->stack, proc->stack_size, proc->sp);
@@ -78,7 +77,6 @@ void draw_memory(char *name,int x, int y, int width, int full_height, int used,
 __attribute__((section(".text.kcoreprocesses")))
 void draw_process_view(){
     gpu_clear(BG_COLOR+0x112211);
-    process_t *processes = get_all_processes();
     gpu_size screen_size = gpu_get_screen_size();
     gpu_point screen_middle = {screen_size.width / 2, screen_size.height / 2};
 
@@ -89,16 +87,16 @@ void draw_process_view(){
         if (kp.keys[0] == KEY_ARROW_LEFT)
             scroll_index = max(scroll_index - 1, 0);
         if (kp.keys[0] == KEY_ARROW_RIGHT)
-            scroll_index = min(scroll_index + 1,MAX_PROCS);
+            scroll_index = min(scroll_index + 1,process_count());
     }
 
     for (int i = 0; i < PROCS_PER_SCREEN; i++) {
         int index = scroll_index;
         int valid_count = 0;
 
-        process_t *proc;
-        while (index < MAX_PROCS) {
-            proc = &processes[index];
+        process_t *proc = NULL;
+        while (index < (int)process_table_size()) {
+            proc = get_process_at(index);
             if (proc->id != 0 && proc->state != STOPPED) {
                 if (valid_count == i + scroll_index) {
                     break;
@@ -108,7 +106,7 @@ void draw_process_view(){
             index++;
         }
 
-        if (proc->id == 0 || valid_count < i || proc->state == STOPPED) break;
+        if (!proc || proc->id == 0 || valid_count < i || proc->state == STOPPED) break;
 
         string name = string_l((const char*)(uintptr_t)proc->name);
         string state = string_l(parse_proc_state(proc->state));
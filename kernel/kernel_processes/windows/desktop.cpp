@@ -7,9 +7,12 @@
 #include "std/string.h"
 #include "filesystem/filesystem.h"
 #include "process/loading/elf_file.h"
+#include "syscalls/syscalls.h"
 
 #define MAX_COLS 3
 #define MAX_ROWS 3
+//How often the desktop wakes up to check on focus and the active process when it gets no input
+#define DESKTOP_IDLE_MSEC 100
 
 void Desktop::add_entry(char* name, char *ext, char* path){
     entries.add({
@@ -51,7 +54,10 @@ Desktop::Desktop() {
 
 void Desktop::draw_desktop(){
     if (!await_gpu()) return;
-    if (active_proc != nullptr && active_proc->state != process_t::process_state::STOPPED) return;
+    if (active_proc != nullptr && active_proc->state != process_t::process_state::STOPPED){
+        sleep(DESKTOP_IDLE_MSEC);
+        return;
+    }
     if (process_active){
         active_proc = nullptr;
         sys_focus_current();
@@ -59,7 +65,9 @@ void Desktop::draw_desktop(){
     }
     keypress kp;
     gpu_point old_selected = selected;
-    while (sys_read_input_current(&kp)){
+    //Once everything is drawn there's nothing to do until a key comes in, or focus moves away and back
+    bool pressed = rendered_full ? read_key_wait(&kp, DESKTOP_IDLE_MSEC) : sys_read_input_current(&kp);
+    for (; pressed; pressed = sys_read_input_current(&kp)){
         for (int i = 0; i < 6; i++){
             char key = kp.keys[i];
             if (key == KEY_ENTER || key == KEY_KEYPAD_ENTER){
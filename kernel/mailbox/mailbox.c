@@ -1,7 +1,11 @@
 #include "mailbox.h"
+#include "memory/dma.h"
 
 int mailbox_call(volatile uint32_t* mbox, uint8_t channel) {
     uint32_t addr = ((uint32_t)(uintptr_t)mbox) & ~0xF;
+    //The first word of a property buffer is its size in bytes
+    uint32_t size = mbox[0];
+    dma_sync_for_device((void*)mbox, size);
 
     while (MBOX_STATUS & MBOX_FULL);
     MBOX_WRITE = addr | (channel & 0xF);
@@ -9,8 +13,10 @@ int mailbox_call(volatile uint32_t* mbox, uint8_t channel) {
     while (1) {
         while (MBOX_STATUS & MBOX_EMPTY);
         uint32_t resp = MBOX_READ;
-        if ((resp & 0xF) == channel && (resp & ~0xF) == addr)
+        if ((resp & 0xF) == channel && (resp & ~0xF) == addr){
+            dma_sync_for_cpu((void*)mbox, size);
             return mbox[1] == 0x80000000;
+        }
         else return false;
     }
 }
\ No newline at end of file
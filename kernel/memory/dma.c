@@ -1,9 +1,45 @@
 #include "dma.h"
 #include "memory/kalloc.h"
+#include "memory/page_allocator.h"
+#include "std/memfunctions.h"
 
 void dma_read(void* dest, uint32_t size, uint64_t pointer) {
     uint8_t* d = (uint8_t*)dest;
     for (uint32_t i = 0; i < size; i++) {
         d[i] = *(volatile uint8_t*)(uintptr_t)(pointer + i);
     }
-}
\ No newline at end of file
+}
+
+void* dma_alloc_coherent(uint64_t size){
+    void *ptr = palloc(size, true, true, true);
+    if (ptr)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
+void dma_free_coherent(void *ptr, uint64_t size){
+    pfree(ptr, size);
+}
+
+static inline uint64_t dcache_line_size(){
+    uint64_t ctr;
+    asm volatile ("mrs %0, ctr_el0" : "=r"(ctr));
+    return 4 << ((ctr >> 16) & 0xF);
+}
+
+void dma_sync_for_device(void *ptr, uint64_t size){
+    uint64_t line = dcache_line_size();
+    uintptr_t end = (uintptr_t)ptr + size;
+    for (uintptr_t addr = (uintptr_t)ptr & ~(line - 1); addr < end; addr += line)
+        asm volatile ("dc cvac, %0" :: "r"(addr) : "memory");
+    asm volatile ("dsb sy" ::: "memory");
+}
+
+//Clean and invalidate rather than just invalidate, so dirty data sharing a line with the buffer isn't lost
+void dma_sync_for_cpu(void *ptr, uint64_t size){
+    uint64_t line = dcache_line_size();
+    uintptr_t end = (uintptr_t)ptr + size;
+    for (uintptr_t addr = (uintptr_t)ptr & ~(line - 1); addr < end; addr += line)
+        asm volatile ("dc civac, %0" :: "r"(addr) : "memory");
+    asm volatile ("dsb sy" ::: "memory");
+}
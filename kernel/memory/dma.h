@@ -2,4 +2,22 @@
 
 #include "types.h"
 
-void dma_read(void* dest, uint32_t size, uint64_t pointer);
\ No newline at end of file
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void dma_read(void* dest, uint32_t size, uint64_t pointer);
+
+//Zeroed, physically contiguous memory mapped normal non-cacheable, so the CPU and devices always agree on its
+//contents. Meant for rings and descriptors that both sides poll
+void* dma_alloc_coherent(uint64_t size);
+void dma_free_coherent(void *ptr, uint64_t size);
+
+//Cache maintenance for cacheable buffers handed to a device. Write back before the device reads them,
+//and drop stale lines before the CPU reads what the device wrote
+void dma_sync_for_device(void *ptr, uint64_t size);
+void dma_sync_for_cpu(void *ptr, uint64_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -103,7 +103,9 @@ void temp_free(void* ptr, uint64_t size) {
         uart_raw_putc('\n');
     }
 
+#ifdef SECURE_MEMORY
     memset((void*)ptr,0,size);
+#endif
 
     FreeBlock* block = (FreeBlock*)ptr;
     block->size = size;
@@ -7,9 +7,21 @@ typedef struct FreeBlock {
     struct FreeBlock* next;
 } FreeBlock;
 
+//kalloc rounds small requests up to a power of two size class from 16 to 2048 bytes
+#define KALLOC_MIN_CLASS 16
+#define KALLOC_CLASSES 8
+#define KALLOC_MAX_CLASS (KALLOC_MIN_CLASS << (KALLOC_CLASSES - 1))
+
 typedef struct mem_page {
     struct mem_page *next;
-    FreeBlock *free_list;
+    //First page of the chain. Only its free lists and tail are used, so any page can find them
+    struct mem_page *head;
+    //Page new blocks are being carved from
+    struct mem_page *tail;
+    FreeBlock *free_lists[KALLOC_CLASSES];
     uint64_t next_free_mem_ptr;
     uint64_t size;
+    //Size class of the block starting at each 16 byte slot of this page, a nibble each. 0 if none starts there,
+    //otherwise the class plus one, so kfree doesn't have to trust the size it's given
+    uint8_t classes[4096 / KALLOC_MIN_CLASS / 2];
 } mem_page;
\ No newline at end of file
@@ -8,17 +8,25 @@
 #include "pci.h"
 #include "filesystem/disk.h"
 #include "memory/page_allocator.h"
+#include "memory/dma.h"
+#include "std/memfunctions.h"
 
 #define MAIR_DEVICE_nGnRnE 0b00000000
 #define MAIR_NORMAL_NOCACHE 0b01000100
+//Inner and outer write-back, read and write allocate
+#define MAIR_NORMAL_WB 0b11111111
 #define MAIR_IDX_DEVICE 0
 #define MAIR_IDX_NORMAL 1
+#define MAIR_IDX_NOCACHE 2
 
 #define PD_TABLE 0b11
 #define PD_BLOCK 0b01
 
+//Software defined, set on user pages the address space allocated itself and frees when it's torn down
+#define OWNED_BIT 55
 #define UXN_BIT 54
 #define PXN_BIT 53
+#define NG_BIT 11
 #define AF_BIT 10
 #define SH_BIT 8
 #define AP_BIT 6
@@ -26,6 +34,10 @@
 
 #define PAGE_TABLE_ENTRIES 512
 
+#define USER_L0_INDEX ((USER_SPACE_BASE >> 39) & 0x1FF)
+
+#define ASID_COUNT 256
+
 uint64_t page_table_l0[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
 
 static bool mmu_verbose;
@@ -41,82 +53,223 @@ void mmu_enable_verbose(){
         }\
     })
 
-void mmu_map_2mb(uint64_t va, uint64_t pa, uint64_t attr_index) {
-    uint64_t l0_index = (va >> 39) & 0x1FF;
-    uint64_t l1_index = (va >> 30) & 0x1FF;
-    uint64_t l2_index = (va >> 21) & 0x1FF;
+#define ADDR_MASK 0xFFFFFFFFF000ULL
 
-    kprintfv("[MMU] Mapping 2mb memory %x at [%i][%i][%i] for EL1", va, l0_index,l1_index,l2_index);
+static uint64_t table_pages;
+static uint64_t block_splits;
 
-    if (!(page_table_l0[l0_index] & 1)) {
-        uint64_t* l1 = (uint64_t*)talloc(PAGE_SIZE);
-        page_table_l0[l0_index] = ((uint64_t)l1 & 0xFFFFFFFFF000ULL) | PD_TABLE;
+static uint64_t* mmu_new_table(){
+    table_pages++;
+    return (uint64_t*)talloc(PAGE_SIZE);
+}
+
+static void mmu_free_table(uint64_t *table){
+    table_pages--;
+    temp_free(table, PAGE_SIZE);
+}
+
+void mmu_table_stats(uint64_t *tables, uint64_t *splits){
+    *tables = table_pages;
+    *splits = block_splits;
+}
+
+static uintptr_t image_map_start;
+static uintptr_t image_map_end;
+static uintptr_t paged_zone_start;
+static bool linear_map_final;
+
+//The kernel image and the part of user RAM below the paged zone, mapped with blocks whose attributes never change
+static inline bool mmu_in_linear_map(uint64_t va, uint64_t size){
+    return (va < paged_zone_start && va + size > get_user_ram_start()) || (va < image_map_end && va + size > image_map_start);
+}
+
+//Level 0 = EL0, Level 1 = EL1, Level 2 = Shared, Level 3 = Read-only for EL0 and EL1
+//Everything but the output address and descriptor type, shared by blocks and pages
+static uint64_t mmu_attributes(uint64_t attr_index, uint64_t level){
+    uint8_t permission = 0b00;
+    switch (level)
+    {
+    case 0: permission = 0b01; break;
+    case 1: permission = 0b00; break;
+    case 2: permission = 0b10; break;
+    case 3: permission = 0b11; break;
+    
+    default:
+        break;
     }
+    //For now EL1 memory is not executable from EL0. We'll need to to separate read_write, read_only and executable sections
+    return ((uint64_t)(level == 1 || level == 3) << UXN_BIT) | ((uint64_t)0 << PXN_BIT) | (1 << AF_BIT) | (0b11 << SH_BIT) | (permission << AP_BIT) | (attr_index << MAIR_BIT);
+}
 
-    uint64_t* l1 = (uint64_t*)(page_table_l0[l0_index] & 0xFFFFFFFFF000ULL);
+static inline bool mmu_is_block(uint64_t entry){
+    return (entry & 0b11) == PD_BLOCK;
+}
 
-    if (!(l1[l1_index] & 1)) {
-        uint64_t* l2 = (uint64_t*)talloc(PAGE_SIZE);
-        l1[l1_index] = ((uint64_t)l2 & 0xFFFFFFFFF000ULL) | PD_TABLE;
+//True when entry is a block that already translates va to pa with these attributes
+static inline bool mmu_block_covers(uint64_t entry, uint64_t block_size, uint64_t va, uint64_t pa, uint64_t attr){
+    if (!mmu_is_block(entry)) return false;
+    if ((entry & ~ADDR_MASK & ~0b11ULL) != attr) return false;
+    return (entry & ADDR_MASK) + (va & (block_size - 1)) == (pa & ADDR_MASK);
+}
+
+//Break-before-make. A valid entry is cleared and invalidated on every core before the new one is written, so no TLB
+//ever holds the old and new translation at once. Whole is for tables, whose pages may be cached under other addresses.
+//Callers hold the kernel lock, and nothing else may be using the memory behind the entry meanwhile
+static void mmu_replace_entry(uint64_t *entry, uint64_t value, uint64_t va, bool whole){
+    if (*entry & 1){
+        *entry = 0;
+        if (whole)
+            asm volatile ("dsb ishst\ntlbi vmalle1is\ndsb ish\nisb" ::: "memory");
+        else
+            asm volatile ("dsb ishst\ntlbi vaae1is, %0\ndsb ish\nisb" :: "r"((va >> 12) & 0xFFFFFFFFFFFULL) : "memory");
     }
+    *entry = value;
+    asm volatile ("dsb ishst\nisb" ::: "memory");
+}
 
-    uint64_t* l2 = (uint64_t*)(l1[l1_index] & 0xFFFFFFFFF000ULL);   
-    
-    //For now we make this not executable. We'll need to to separate read_write, read_only and executable sections
-    uint64_t attr = ((uint64_t)1 << UXN_BIT) | ((uint64_t)0 << PXN_BIT) | (1 << AF_BIT) | (0b11 << SH_BIT) | (0b00 << AP_BIT) | (attr_index << MAIR_BIT) | PD_BLOCK;
-    l2[l2_index] = (pa & 0xFFFFFFFFF000ULL) | attr;
+//Table an entry points to. Empty entries get a new table, blocks are broken down into a table of the next granule
+//that reproduces them, so only the part being remapped changes. The block is unmapped while it's swapped, which is
+//why the blocks of the kernel image and linear map are never split once the MMU is on
+static uint64_t* mmu_table_for(uint64_t *entry, uint64_t block_size, uint64_t va){
+    if (!(*entry & 1)){
+        uint64_t *table = mmu_new_table();
+        *entry = ((uint64_t)table & ADDR_MASK) | PD_TABLE;
+        return table;
+    }
+    if (mmu_is_block(*entry)){
+        uint64_t *table = mmu_new_table();
+        uint64_t granule = block_size / PAGE_TABLE_ENTRIES;
+        uint64_t base = *entry & ADDR_MASK;
+        uint64_t attr = (*entry & ~ADDR_MASK & ~0b11ULL) | (granule == GRANULE_4KB ? 0b11 : PD_BLOCK);
+        for (uint64_t i = 0; i < PAGE_TABLE_ENTRIES; i++)
+            table[i] = (base + i * granule) | attr;
+        mmu_replace_entry(entry, ((uint64_t)table & ADDR_MASK) | PD_TABLE, va, false);
+        block_splits++;
+        kprintfv("[MMU] Split %x block at %x", block_size, base);
+        return table;
+    }
+    return (uint64_t*)(*entry & ADDR_MASK);
+}
+
+//A table can be folded into a block when every valid entry is what the block would map anyway
+static bool mmu_table_foldable(uint64_t *table, uint64_t granule, uint64_t pa, uint64_t attr){
+    uint64_t type = granule == GRANULE_4KB ? 0b11 : PD_BLOCK;
+    for (uint64_t i = 0; i < PAGE_TABLE_ENTRIES; i++){
+        if ((table[i] & 1) && table[i] != (((pa + i * granule) & ADDR_MASK) | attr | type))
+            return false;
+    }
+    return true;
 }
 
-//Level 0 = EL0, Level 1 = EL1, Level 2 = Shared
-void mmu_map_4kb(uint64_t va, uint64_t pa, uint64_t attr_index, uint64_t level) {
+//Writes a block into an entry. With replace, whatever was mapped there belongs to the caller and is discarded.
+//Without it the block only goes into empty entries, or over tables that would map the same thing
+static bool mmu_set_block(uint64_t *entry, uint64_t block_size, uint64_t va, uint64_t pa, uint64_t attr, bool replace){
+    uint64_t block = (pa & ADDR_MASK) | attr | PD_BLOCK;
+    if ((*entry & 1) && !mmu_is_block(*entry)){
+        uint64_t *table = (uint64_t*)(*entry & ADDR_MASK);
+        //Tables under 1GB blocks can hold tables themselves, those are never folded
+        if (block_size != GRANULE_2MB) return false;
+        if (!replace && !mmu_table_foldable(table, GRANULE_4KB, pa, attr)) return false;
+        //The walkers may still hold the table until it's invalidated
+        mmu_replace_entry(entry, block, va, true);
+        mmu_free_table(table);
+        return true;
+    } else if ((*entry & 1) && !replace && *entry != block){
+        return false;
+    }
+    if (*entry != block)
+        mmu_replace_entry(entry, block, va, false);
+    return true;
+}
+
+static bool mmu_map_1gb(uint64_t va, uint64_t pa, uint64_t attr_index, uint64_t level, bool replace) {
+    uint64_t l0_index = (va >> 39) & 0x1FF;
+    uint64_t l1_index = (va >> 30) & 0x1FF;
+
+    kprintfv("[MMU] Mapping 1gb memory %x at [%i][%i] for EL%i", va, l0_index,l1_index,level);
+
+    uint64_t* l1 = mmu_table_for(&page_table_l0[l0_index], 0, va);
+    return mmu_set_block(&l1[l1_index], GRANULE_1GB, va, pa, mmu_attributes(attr_index, level), replace);
+}
+
+static bool mmu_map_2mb(uint64_t va, uint64_t pa, uint64_t attr_index, uint64_t level, bool replace) {
+    uint64_t l0_index = (va >> 39) & 0x1FF;
+    uint64_t l1_index = (va >> 30) & 0x1FF;
+    uint64_t l2_index = (va >> 21) & 0x1FF;
+
+    kprintfv("[MMU] Mapping 2mb memory %x at [%i][%i][%i] for EL%i", va, l0_index,l1_index,l2_index,level);
+
+    uint64_t attr = mmu_attributes(attr_index, level);
+    uint64_t* l1 = mmu_table_for(&page_table_l0[l0_index], 0, va);
+    if (mmu_block_covers(l1[l1_index], GRANULE_1GB, va, pa, attr)) return true;
+    if (!replace && mmu_is_block(l1[l1_index])) return false;
+
+    uint64_t* l2 = mmu_table_for(&l1[l1_index], GRANULE_1GB, va);
+    return mmu_set_block(&l2[l2_index], GRANULE_2MB, va, pa, attr, replace);
+}
+
+static bool mmu_map_page(uint64_t *root, uint64_t va, uint64_t pa, uint64_t attr, bool replace) {
     uint64_t l0_index = (va >> 39) & 0x1FF;
     uint64_t l1_index = (va >> 30) & 0x1FF;
     uint64_t l2_index = (va >> 21) & 0x1FF;
     uint64_t l3_index = (va >> 12) & 0x1FF;
 
-    if (!(page_table_l0[l0_index] & 1)) {
-        uint64_t* l1 = (uint64_t*)talloc(PAGE_SIZE);
-        page_table_l0[l0_index] = ((uint64_t)l1 & 0xFFFFFFFFF000ULL) | PD_TABLE;
-    }
-    
-    uint64_t* l1 = (uint64_t*)(page_table_l0[l0_index] & 0xFFFFFFFFF000ULL);
-    if (!(l1[l1_index] & 1)) {
-        uint64_t* l2 = (uint64_t*)talloc(PAGE_SIZE);
-        l1[l1_index] = ((uint64_t)l2 & 0xFFFFFFFFF000ULL) | PD_TABLE;
-    }
-    
-    uint64_t* l2 = (uint64_t*)(l1[l1_index] & 0xFFFFFFFFF000ULL);
-    uint64_t l2_val = l2[l2_index];
-    if (!(l2_val & 1)) {
-        uint64_t* l3 = (uint64_t*)talloc(PAGE_SIZE);
-        l2[l2_index] = ((uint64_t)l3 & 0xFFFFFFFFF000ULL) | PD_TABLE;
-    } else if ((l2_val & 0b11) == PD_BLOCK){
-        kprintf("[MMU error]: Region not mapped for address %x, already mapped at higher granularity [%i][%i][%i][%i]",va, l0_index,l1_index,l2_index,l3_index);
-        return;
-    }
-    
-    uint64_t* l3 = (uint64_t*)(l2[l2_index] & 0xFFFFFFFFF000ULL);
+    uint64_t* l1 = mmu_table_for(&root[l0_index], 0, va);
+    if (mmu_block_covers(l1[l1_index], GRANULE_1GB, va, pa, attr)) return false;
+    if (!replace && mmu_is_block(l1[l1_index])) return false;
+
+    uint64_t* l2 = mmu_table_for(&l1[l1_index], GRANULE_1GB, va);
+    if (mmu_block_covers(l2[l2_index], GRANULE_2MB, va, pa, attr)) return false;
+    if (!replace && mmu_is_block(l2[l2_index])) return false;
+
+    uint64_t* l3 = mmu_table_for(&l2[l2_index], GRANULE_2MB, va);
+    if (!replace && (l3[l3_index] & 1)) return false;
     
-    if (l3[l3_index] & 1){
+    //Pages go back to the page allocator still mapped, so the next owner rewrites the attributes in place
+    if ((l3[l3_index] & 1) && (l3[l3_index] & ADDR_MASK) != (pa & ADDR_MASK)){
         kprintf("[MMU warning]: Section already mapped %x",va);
-        return;
+        return false;
     }
     
-    uint8_t permission;
-    
-    switch (level)
-    {
-    case 0: permission = 0b01; break;
-    case 1: permission = 0b00; break;
-    case 2: permission = 0b10; break;
+    uint64_t entry = (pa & ADDR_MASK) | attr | 0b11;
+    if (l3[l3_index] == entry) return false;
+
+    kprintfv("[MMU] Mapping 4kb memory %x at [%i][%i][%i][%i] = %x | %x", va, l0_index,l1_index,l2_index,l3_index,pa,entry);
     
-    default:
-        break;
+    mmu_replace_entry(&l3[l3_index], entry, va, false);
+    return true;
+}
+
+//Returns whether the tables changed. Addresses already inside a block with the same attributes are left alone,
+//anything else breaks the block down to 4kb pages
+bool mmu_map_4kb(uint64_t va, uint64_t pa, uint64_t attr_index, uint64_t level) {
+    uint64_t attr = mmu_attributes(attr_index, level);
+    if (linear_map_final && mmu_in_linear_map(va, GRANULE_4KB) && (va != pa || attr != mmu_attributes(MAIR_IDX_NORMAL, 1))){
+        kprintf("[MMU error] %x is in the linear map, whose blocks are never split", va);
+        return false;
+    }
+    return mmu_map_page(page_table_l0, va, pa, attr, true);
+}
+
+//Maps [va, va + size) with the largest blocks alignment allows and 4kb pages at the unaligned edges, or only pages
+//without blocks. Without replace, only memory nothing else has mapped yet is filled in
+static void mmu_map_range(uint64_t va, uint64_t pa, uint64_t size, uint64_t attr_index, uint64_t level, bool replace, bool blocks){
+    uint64_t end = va + size;
+    while (va < end){
+        uint64_t remaining = end - va;
+        if (blocks && !((va | pa) & (GRANULE_1GB - 1)) && remaining >= GRANULE_1GB && mmu_map_1gb(va, pa, attr_index, level, replace)){
+            va += GRANULE_1GB;
+            pa += GRANULE_1GB;
+        } else if (blocks && !((va | pa) & (GRANULE_2MB - 1)) && remaining >= GRANULE_2MB){
+            mmu_map_2mb(va, pa, attr_index, level, replace);
+            va += GRANULE_2MB;
+            pa += GRANULE_2MB;
+        } else {
+            mmu_map_page(page_table_l0, va, pa, mmu_attributes(attr_index, level), replace);
+            va += GRANULE_4KB;
+            pa += GRANULE_4KB;
+        }
     }
-    uint64_t attr = ((uint64_t)(level == 1) << UXN_BIT) | ((uint64_t)0 << PXN_BIT) | (1 << AF_BIT) | (0b01 << SH_BIT) | (permission << AP_BIT) | (attr_index << MAIR_BIT) | 0b11;
-    kprintfv("[MMU] Mapping 4kb memory %x at [%i][%i][%i][%i] for EL%i = %x | %x permission: %i", va, l0_index,l1_index,l2_index,l3_index,level,pa,attr,permission);
-    
-    l3[l3_index] = (pa & 0xFFFFFFFFF000ULL) | attr;
 }
 
 static inline void mmu_flush_all() {
@@ -135,6 +288,12 @@ static inline void mmu_flush_icache() {
     );
 }
 
+//Newly written code has to reach the point of unification before the instruction cache can see it
+void mmu_sync_code(void *addr, uint64_t size){
+    dma_sync_for_device(addr, size);
+    mmu_flush_icache();
+}
+
 void mmu_unmap(uint64_t va, uint64_t pa){
     
     uint64_t l0_index = (va >> 39) & 0x1FF;
@@ -145,18 +304,14 @@ void mmu_unmap(uint64_t va, uint64_t pa){
     kprintfv("[MMU] Unmapping 4kb memory %x at [%i][%i][%i][%i] for EL1", va, l0_index,l1_index,l2_index, l3_index);
     if (!(page_table_l0[l0_index] & 1)) return;
     
-    uint64_t* l1 = (uint64_t*)(page_table_l0[l0_index] & 0xFFFFFFFFF000ULL);
+    uint64_t* l1 = (uint64_t*)(page_table_l0[l0_index] & ADDR_MASK);
     if (!(l1[l1_index] & 1)) return;
     
-    uint64_t* l2 = (uint64_t*)(l1[l1_index] & 0xFFFFFFFFF000ULL);
-    uint64_t l3_val = l2[l2_index];
-    if (!(l3_val & 1)) return;
-    else if ((l3_val & 0b11) == PD_BLOCK){
-        l2[l2_index] = 0;
-        return;
-    }
+    //Only the page goes away, the rest of a block around it stays mapped
+    uint64_t* l2 = mmu_table_for(&l1[l1_index], GRANULE_1GB, va);
+    if (!(l2[l2_index] & 1)) return;
     
-    uint64_t* l3 = (uint64_t*)(l2[l2_index] & 0xFFFFFFFFF000ULL);
+    uint64_t* l3 = mmu_table_for(&l2[l2_index], GRANULE_2MB, va);
 
     l3[l3_index] = 0;
 
@@ -164,6 +319,132 @@ void mmu_unmap(uint64_t va, uint64_t pa){
     mmu_flush_icache();
 }
 
+uint64_t* mmu_kernel_table(){
+    return page_table_l0;
+}
+
+//Process tables point at the kernel's own L1 tables for everything outside the user slot, so later kernel mappings
+//show up in every process. Kernel L0 entries are all in place by the time the first process is created, the vDSO's included
+uint64_t* mmu_new_address_space(){
+    uint64_t *l0 = mmu_new_table();
+    for (uint64_t i = 0; i < PAGE_TABLE_ENTRIES; i++)
+        if (i != USER_L0_INDEX)
+            l0[i] = page_table_l0[i];
+    return l0;
+}
+
+//Not global, so the mapping is tagged with the process' ASID, and never executable by the kernel
+bool mmu_map_user(uint64_t *l0, uint64_t va, uint64_t pa, bool owned){
+    if (va < USER_SPACE_BASE || va >= USER_SPACE_END) return false;
+    uint64_t attr = mmu_attributes(MAIR_IDX_NORMAL, 0) | ((uint64_t)1 << PXN_BIT) | (1 << NG_BIT) | ((uint64_t)owned << OWNED_BIT);
+    bool changed = mmu_map_page(l0, va, pa, attr, false);
+    //Nothing was mapped here before, so there's nothing to invalidate. The walker only has to see the new entry
+    asm volatile ("dsb ishst\nisb" ::: "memory");
+    return changed;
+}
+
+//Physical address behind va, blocks included, or 0 when it isn't mapped
+uintptr_t mmu_translate(uint64_t *l0, uint64_t va){
+    uint64_t *table = l0;
+    for (uint64_t shift = 39; shift >= 12; shift -= 9){
+        uint64_t entry = table[(va >> shift) & 0x1FF];
+        if (!(entry & 1)) return 0;
+        uint64_t size = 1ULL << shift;
+        if (shift == 12 || mmu_is_block(entry))
+            return (entry & ADDR_MASK & ~(size - 1)) | (va & (size - 1));
+        table = (uint64_t*)(entry & ADDR_MASK);
+    }
+    return 0;
+}
+
+//Physical address behind a user address, or 0 when it isn't mapped
+uintptr_t mmu_user_translate(uint64_t *l0, uint64_t va){
+    if (va < USER_SPACE_BASE || va >= USER_SPACE_END) return 0;
+    return mmu_translate(l0, va);
+}
+
+//Clears the 4kb page at va and invalidates it on every core. Global entries match any ASID.
+//Returns the page it pointed at, 0 if va wasn't mapped by a page
+uintptr_t mmu_unmap_page(uint64_t *l0, uint64_t va, uint16_t asid){
+    uint64_t *table = l0;
+    for (uint64_t shift = 39; shift > 12; shift -= 9){
+        uint64_t entry = table[(va >> shift) & 0x1FF];
+        if (!(entry & 1) || mmu_is_block(entry)) return 0;
+        table = (uint64_t*)(entry & ADDR_MASK);
+    }
+    uint64_t *entry = &table[(va >> 12) & 0x1FF];
+    if (!(*entry & 1)) return 0;
+    uintptr_t pa = *entry & ADDR_MASK;
+    *entry = 0;
+    asm volatile (
+        "dsb ishst\n"
+        "tlbi vae1is, %0\n"
+        "dsb ish\n"
+        "isb\n"
+        :: "r"(((uint64_t)asid << 48) | ((va >> 12) & 0xFFFFFFFFFFFULL)) : "memory");
+    return pa;
+}
+
+//Frees the pages the address space owns and every table under the user slot. The shared kernel tables stay
+void mmu_free_address_space(uint64_t *l0){
+    uint64_t entry = l0[USER_L0_INDEX];
+    if (entry & 1){
+        uint64_t *l1 = (uint64_t*)(entry & ADDR_MASK);
+        for (uint64_t i = 0; i < PAGE_TABLE_ENTRIES; i++){
+            if (!(l1[i] & 1)) continue;
+            uint64_t *l2 = (uint64_t*)(l1[i] & ADDR_MASK);
+            for (uint64_t j = 0; j < PAGE_TABLE_ENTRIES; j++){
+                if (!(l2[j] & 1)) continue;
+                uint64_t *l3 = (uint64_t*)(l2[j] & ADDR_MASK);
+                for (uint64_t k = 0; k < PAGE_TABLE_ENTRIES; k++)
+                    if ((l3[k] & 1) && (l3[k] >> OWNED_BIT) & 1)
+                        pfree((void*)(l3[k] & ADDR_MASK), GRANULE_4KB);
+                mmu_free_table(l3);
+            }
+            mmu_free_table(l2);
+        }
+        mmu_free_table(l1);
+    }
+    mmu_free_table(l0);
+}
+
+static uint64_t asid_map[ASID_COUNT / 64] = { 1 };
+
+//0 belongs to the kernel tables, which only hold global entries. Once every ASID is taken, processes share 0
+//and the scheduler flushes it whenever it switches between two of them
+uint16_t mmu_asid_alloc(){
+    for (uint16_t i = 0; i < ASID_COUNT / 64; i++){
+        if (asid_map[i] == UINT64_MAX) continue;
+        uint16_t bit = __builtin_ctzll(~asid_map[i]);
+        asid_map[i] |= 1ULL << bit;
+        return (i * 64) + bit;
+    }
+    return 0;
+}
+
+//Entries tagged with the ASID may still be in any core's TLB, the next owner must not see them
+void mmu_asid_free(uint16_t asid){
+    if (asid)
+        asid_map[asid / 64] &= ~(1ULL << (asid % 64));
+    asm volatile (
+        "dsb ishst\n"
+        "tlbi aside1is, %0\n"
+        "dsb ish\n"
+        "isb\n"
+        :: "r"((uint64_t)asid << 48) : "memory");
+}
+
+void mmu_load_address_space(uint64_t *l0, uint16_t asid, bool flush){
+    asm volatile ("msr ttbr0_el1, %0\nisb" :: "r"((uint64_t)l0 | ((uint64_t)asid << 48)) : "memory");
+    if (flush)
+        asm volatile (
+            "dsb nshst\n"
+            "tlbi aside1, %0\n"
+            "dsb nsh\n"
+            "isb\n"
+            :: "r"((uint64_t)asid << 48) : "memory");
+}
+
 void mmu_alloc(){
     //TODO: use palloc, but consider it won't be able to add sections to MMU during that init
 }
@@ -172,8 +453,21 @@ void mmu_init() {
     //TODO: Move these hardcoded mappings to their own file
     uint64_t kstart = mem_get_kmem_start();
     uint64_t kend = mem_get_kmem_end();
-    for (uint64_t addr = kstart; addr <= kend; addr += GRANULE_2MB)
-        mmu_map_2mb(addr, addr, MAIR_IDX_NORMAL);
+    //The kernel image and the linear map get blocks with their final attributes. Stacks and page tables in them are
+    //used without the kernel lock, by the exception entry and idle loop, and by the core that's changing the tables
+    //itself, so none of these blocks is ever unmapped to be split. Memory that needs other attributes comes from
+    //the paged zone instead
+    //From the 2MB boundary below the image, which on the Pi holds the spin table secondary cores are released through
+    image_map_start = kstart & ~(GRANULE_2MB - 1);
+    image_map_end = kend + GRANULE_2MB;
+    mmu_map_range(image_map_start, image_map_start, image_map_end - image_map_start, MAIR_IDX_NORMAL, 1, true, true);
+
+    //Linear map of RAM for the kernel, which covers the allocator's metadata. DMA pages allocated before this point
+    //are in the paged zone and keep their mappings, kernel pages never need an entry of their own
+    uint64_t paged_size;
+    page_allocator_paged_zone(&paged_zone_start, &paged_size);
+    mmu_map_range(get_user_ram_start(), get_user_ram_start(), paged_zone_start - get_user_ram_start(), MAIR_IDX_NORMAL, 1, false, true);
+    mmu_map_range(paged_zone_start, paged_zone_start, paged_size, MAIR_IDX_NORMAL, 1, false, false);
 
     for (uint64_t addr = get_uart_base(); addr <= get_uart_base(); addr += GRANULE_4KB)
         mmu_map_4kb(addr, addr, MAIR_IDX_DEVICE, 1);
@@ -195,11 +489,21 @@ void mmu_init() {
             mmu_map_4kb(addr, addr, MAIR_IDX_NORMAL, 1);
     }
 
-    uint64_t mair = (MAIR_DEVICE_nGnRnE << (MAIR_IDX_DEVICE * 8)) | (MAIR_NORMAL_NOCACHE << (MAIR_IDX_NORMAL * 8));
+    mmu_init_core();
+    mem_device_access = false;
+    linear_map_final = true;
+
+    kprintf("Finished MMU init, %i page table pages", table_pages);
+}
+
+//Loads the shared tables on the calling core and turns its MMU on. Secondary cores call this directly
+void mmu_init_core() {
+    uint64_t mair = (MAIR_DEVICE_nGnRnE << (MAIR_IDX_DEVICE * 8)) | (MAIR_NORMAL_WB << (MAIR_IDX_NORMAL * 8)) | (MAIR_NORMAL_NOCACHE << (MAIR_IDX_NOCACHE * 8));
     asm volatile ("msr mair_el1, %0" :: "r"(mair));
 
     //30 = Translation granule EL1. 10 = 4kb | 14 = TG EL0 00 = 4kb
-    uint64_t tcr = ((64 - 48) << 0) | ((64 - 48) << 16) | (0b00 << 14) | (0b10 << 30);
+    //8/10 = Table walks through write-back inner and outer caches | 12 = Walks inner shareable
+    uint64_t tcr = ((64 - 48) << 0) | ((64 - 48) << 16) | (0b00 << 14) | (0b10 << 30) | (0b01 << 8) | (0b01 << 10) | (0b11 << 12);
     asm volatile ("msr tcr_el1, %0" :: "r"(tcr));
 
     asm volatile ("dsb ish");
@@ -210,6 +514,8 @@ void mmu_init() {
     asm volatile (
         "mrs x0, sctlr_el1\n"
         "orr x0, x0, #0x1\n"
+        "orr x0, x0, #(1 << 2)\n"//Data cache
+        "orr x0, x0, #(1 << 12)\n"//Instruction cache
         "bic x0, x0, #(1 << 19)\n"
         "msr sctlr_el1, x0\n"
         "isb\n"
@@ -217,8 +523,6 @@ void mmu_init() {
     );
     uint64_t sctlr;
     asm volatile ("mrs %0, sctlr_el1" : "=r"(sctlr));
-
-    kprintf("Finished MMU init");
 }
 
 void register_device_memory(uint64_t va, uint64_t pa){
@@ -228,19 +532,58 @@ void register_device_memory(uint64_t va, uint64_t pa){
 }
 
 void register_device_memory_2mb(uint64_t va, uint64_t pa){
-    mmu_map_2mb(va, pa, MAIR_IDX_DEVICE);
+    mmu_map_2mb(va, pa, MAIR_IDX_DEVICE, 1, true);
     mmu_flush_all();
     mmu_flush_icache();
 }
 
+//RAM shared with devices. Lines cached while the page had a cacheable mapping are written back and dropped,
+//so they can't be evicted over what the device writes later
+void register_dma_memory(uint64_t va, uint64_t pa){
+    register_dma_range(va, pa, GRANULE_4KB);
+}
+
+//The caller owns the whole range, so aligned 2MB stretches of it become blocks. In RAM that's the paged zone,
+//the linear map can't change type
+void register_dma_range(uint64_t va, uint64_t pa, uint64_t size){
+    if (linear_map_final && mmu_in_linear_map(va, size)){
+        kprintf("[MMU error] DMA range %x is in the linear map", va);
+        return;
+    }
+    mmu_map_range(va, pa, size, MAIR_IDX_NOCACHE, 1, true, true);
+    mmu_flush_all();
+    dma_sync_for_cpu((void*)va, size);
+}
+
+//Splits the blocks register_dma_range made back into pages before the range is freed, while the caller still owns
+//all of it. Later allocations out of it then only ever rewrite their own pages
+void release_dma_range(uint64_t va, uint64_t size){
+    for (uint64_t addr = (va + GRANULE_2MB - 1) & ~(GRANULE_2MB - 1); addr + GRANULE_2MB <= va + size; addr += GRANULE_2MB){
+        uint64_t l0_entry = page_table_l0[(addr >> 39) & 0x1FF];
+        if (!(l0_entry & 1)) continue;
+        uint64_t *l1 = (uint64_t*)(l0_entry & ADDR_MASK);
+        uint64_t *l1_entry = &l1[(addr >> 30) & 0x1FF];
+        if (!(*l1_entry & 1) || mmu_is_block(*l1_entry)) continue;
+        uint64_t *l2_entry = &((uint64_t*)(*l1_entry & ADDR_MASK))[(addr >> 21) & 0x1FF];
+        if (mmu_is_block(*l2_entry))
+            mmu_table_for(l2_entry, GRANULE_2MB, addr);
+    }
+}
+
 void register_proc_memory(uint64_t va, uint64_t pa, bool kernel){
-    mmu_map_4kb(va, pa, MAIR_IDX_NORMAL, kernel);
+    if (!mmu_map_4kb(va, pa, MAIR_IDX_NORMAL, kernel)) return;
     mmu_flush_all();
     mmu_flush_icache();
 }
 
+//Maps pa a second time at va, readable but not writable from EL0. The kernel keeps writing through its own mapping
+void register_user_readonly_memory(uint64_t va, uint64_t pa){
+    mmu_map_4kb(va, pa, MAIR_IDX_NORMAL, 3);
+    mmu_flush_all();
+}
+
 void debug_mmu_address(uint64_t va){
-    uint64_t l0_index = (va >> 37) & 0x1FF;
+    uint64_t l0_index = (va >> 39) & 0x1FF;
     uint64_t l1_index = (va >> 30) & 0x1FF;
     uint64_t l2_index = (va >> 21) & 0x1FF;
     uint64_t l3_index = (va >> 12) & 0x1FF;
@@ -256,6 +599,11 @@ void debug_mmu_address(uint64_t va){
         kprintf("L2 Table missing");
         return;
     }
+    if (mmu_is_block(l1[l1_index])){
+        kprintf("Mapped as 1GB memory in L2");
+        kprintf("Entry: %x", l1[l1_index]);
+        return;
+    }
     uint64_t* l2 = (uint64_t*)(l1[l1_index] & 0xFFFFFFFFF000ULL);
     uint64_t l3_val = l2[l2_index];
     if (!(l3_val & 1)) {
@@ -4,19 +4,55 @@
 
 #define GRANULE_4KB 0x1000
 #define GRANULE_2MB 0x200000
+#define GRANULE_1GB 0x40000000
+
+//User processes get the second 512GB of TTBR0 to themselves, the kernel's identity map stays in the first
+#define USER_SPACE_BASE 0x8000000000ULL
+#define USER_SPACE_END 0x10000000000ULL
+//Link address of user programs, see user/linker.ld
+#define USER_CODE_BASE USER_SPACE_BASE
+#define USER_STACK_TOP (USER_SPACE_BASE + 0x2000000000ULL)
+//Pages the kernel shares with a process, like its syscall ring, show up at USER_HEAP_BASE plus their physical address
+#define USER_HEAP_BASE (USER_SPACE_BASE + 0x4000000000ULL)
+//Stacks reserve this much below USER_STACK_TOP and only get pages where they're touched, see demand_paging.c
+#define USER_STACK_RESERVE 0x800000
+//Large allocations reserve address space here and get pages on first touch
+#define USER_RESERVE_BASE (USER_SPACE_BASE + 0x3000000000ULL)
+
+//Kernel process stacks, one slot per process table entry. The lowest page of a slot is never mapped
+#define KERNEL_STACKS_BASE 0x10000000000ULL
+#define KERNEL_STACK_SLOT 0x100000
 
 void mmu_alloc();
 void mmu_init();
+void mmu_init_core();
 #ifdef __cplusplus
 extern "C" {
 #endif
 void register_device_memory(uint64_t va, uint64_t pa);
 void register_device_memory_2mb(uint64_t va, uint64_t pa);
+void register_dma_memory(uint64_t va, uint64_t pa);
+void register_dma_range(uint64_t va, uint64_t pa, uint64_t size);
+void release_dma_range(uint64_t va, uint64_t size);
 void register_proc_memory(uint64_t va, uint64_t pa, bool kernel);
+void register_user_readonly_memory(uint64_t va, uint64_t pa);
 #ifdef __cplusplus
 }
 #endif
 void debug_mmu_address(uint64_t va);
 void mmu_enable_verbose();
 
-void mmu_unmap(uint64_t va, uint64_t pa);
\ No newline at end of file
+void mmu_unmap(uint64_t va, uint64_t pa);
+void mmu_sync_code(void *addr, uint64_t size);
+void mmu_table_stats(uint64_t *tables, uint64_t *splits);
+
+uint64_t* mmu_kernel_table();
+uint64_t* mmu_new_address_space();
+void mmu_free_address_space(uint64_t *l0);
+bool mmu_map_user(uint64_t *l0, uint64_t va, uint64_t pa, bool owned);
+uintptr_t mmu_user_translate(uint64_t *l0, uint64_t va);
+uintptr_t mmu_translate(uint64_t *l0, uint64_t va);
+uintptr_t mmu_unmap_page(uint64_t *l0, uint64_t va, uint16_t asid);
+uint16_t mmu_asid_alloc();
+void mmu_asid_free(uint16_t asid);
+void mmu_load_address_space(uint64_t *l0, uint16_t asid, bool flush);
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "exceptions/exception_handler.h"
 #include "std/memfunctions.h"
+#include "hw/smp.h"
 
 #define PD_TABLE 0b11
 #define PD_BLOCK 0b01
@@ -12,9 +13,35 @@
 #define BOOT_PGD_ATTR PD_TABLE
 #define BOOT_PUD_ATTR PD_TABLE
 
-#define PAGE_TABLE_ENTRIES 65536
-
-uint64_t mem_bitmap[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+//Binary buddy allocator over user RAM. Block sizes go from one page (order 0) to 32MB (order 13), enough
+//for a framebuffer in one piece. Free pages aren't mapped once the MMU is on, so the free lists are kept
+//in a per-page array at the start of user RAM instead of inside the free pages themselves
+#define BUDDY_MAX_ORDER 13
+#define BUDDY_NONE UINT32_MAX
+//Set on the first page of a block while it sits on a free list
+#define BUDDY_FREE 0x80
+//Set on the first page of a run handed out by palloc, whose length in pages is kept in next
+#define BUDDY_RUN 0x40
+
+//The top of user RAM is the paged zone, mapped in 4kb pages so allocations from it can take attributes of their
+//own: DMA buffers and EL0 pages. Everything else comes from the linear zone below it, whose block mappings never change
+#define PAGED_ZONE_MAX 0x4000000
+#define ZONE_LINEAR 0
+#define ZONE_PAGED 1
+
+typedef struct {
+    uint32_t next;
+    uint32_t prev;
+    uint8_t order;
+} buddy_page;
+
+static buddy_page *buddy_pages;
+static uintptr_t buddy_base;
+static uint64_t buddy_count;
+static uint64_t buddy_meta_size;
+static uint64_t buddy_free_count;
+static uint32_t paged_first;
+static uint32_t free_lists[2][BUDDY_MAX_ORDER + 1];
 
 static bool page_alloc_verbose = false;
 
@@ -29,74 +56,227 @@ void page_alloc_enable_verbose(){
         }\
     })
 
+static inline int buddy_zone(uint32_t idx){
+    return idx >= paged_first ? ZONE_PAGED : ZONE_LINEAR;
+}
+
+static void buddy_push(uint32_t idx, uint8_t order){
+    buddy_page *page = &buddy_pages[idx];
+    uint32_t *list = &free_lists[buddy_zone(idx)][order];
+    page->order = order | BUDDY_FREE;
+    page->prev = BUDDY_NONE;
+    page->next = *list;
+    if (page->next != BUDDY_NONE)
+        buddy_pages[page->next].prev = idx;
+    *list = idx;
+    buddy_free_count += 1ULL << order;
+}
+
+static void buddy_unlink(uint32_t idx){
+    buddy_page *page = &buddy_pages[idx];
+    uint8_t order = page->order & ~BUDDY_FREE;
+    if (page->prev != BUDDY_NONE)
+        buddy_pages[page->prev].next = page->next;
+    else
+        free_lists[buddy_zone(idx)][order] = page->next;
+    if (page->next != BUDDY_NONE)
+        buddy_pages[page->next].prev = page->prev;
+    page->order = order;
+    buddy_free_count -= 1ULL << order;
+}
+
+//Takes the smallest free block of the zone that fits and splits it down, giving the upper halves back to their lists
+static uint32_t buddy_alloc(int zone, uint8_t order){
+    for (uint8_t o = order; o <= BUDDY_MAX_ORDER; o++){
+        uint32_t idx = free_lists[zone][o];
+        if (idx == BUDDY_NONE) continue;
+        buddy_unlink(idx);
+        while (o > order){
+            o--;
+            buddy_push(idx + (1U << o), o);
+        }
+        buddy_pages[idx].order = order;
+        return idx;
+    }
+    return BUDDY_NONE;
+}
+
+//Merges the block with its buddy for as long as the buddy is a free block of the same order in the same zone
+static void buddy_free(uint32_t idx){
+    uint8_t order = buddy_pages[idx].order;
+    while (order < BUDDY_MAX_ORDER){
+        uint32_t buddy = idx ^ (1U << order);
+        if (buddy >= buddy_count || buddy_zone(buddy) != buddy_zone(idx) || buddy_pages[buddy].order != (order | BUDDY_FREE)) break;
+        buddy_unlink(buddy);
+        if (buddy < idx) idx = buddy;
+        order++;
+    }
+    buddy_push(idx, order);
+}
+
+//Gives back count pages starting at idx as the largest aligned blocks that fit
+static void buddy_release(uint32_t idx, uint64_t count){
+    while (count){
+        uint8_t order = 0;
+        while (order < BUDDY_MAX_ORDER && !(idx & (1U << order)) && (2ULL << order) <= count)
+            order++;
+        buddy_pages[idx].order = order;
+        buddy_free(idx);
+        idx += 1U << order;
+        count -= 1ULL << order;
+    }
+}
+
+//Allocates exactly count contiguous pages by taking the block that fits and trimming its tail off
+static uint32_t buddy_alloc_run(int zone, uint64_t count){
+    uint8_t order = 0;
+    while ((1ULL << order) < count) order++;
+    if (order > BUDDY_MAX_ORDER) return BUDDY_NONE;
+    uint32_t idx = buddy_alloc(zone, order);
+    if (idx == BUDDY_NONE) return BUDDY_NONE;
+    buddy_release(idx + count, (1ULL << order) - count);
+    buddy_pages[idx].order = BUDDY_RUN;
+    buddy_pages[idx].next = count;
+    return idx;
+}
+
+//Pulls a single page out of whichever free block contains it, splitting the block around it
+static void buddy_reserve(uint32_t idx){
+    uint8_t o = 0;
+    uint32_t head = idx;
+    while (buddy_pages[head].order != (o | BUDDY_FREE)){
+        if (++o > BUDDY_MAX_ORDER) return;
+        head = idx & ~((1U << o) - 1);
+    }
+    buddy_unlink(head);
+    while (o > 0){
+        o--;
+        uint32_t half = 1U << o;
+        if (idx >= head + half){
+            buddy_push(head, o);
+            head += half;
+        } else buddy_push(head + half, o);
+    }
+    buddy_pages[idx].order = 0;
+}
+
 void page_allocator_init() {
-    for (int i = 0; i < PAGE_TABLE_ENTRIES; i++) {
-        mem_bitmap[i] = 0;
+    buddy_base = get_user_ram_start();
+    buddy_count = (get_user_ram_end() - buddy_base) / PAGE_SIZE;
+    buddy_pages = (buddy_page*)buddy_base;
+    buddy_meta_size = (buddy_count * sizeof(buddy_page) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    buddy_free_count = 0;
+    //A quarter of RAM at most, in whole 2MB blocks so the linear zone's end stays block aligned
+    uint64_t paged_size = (buddy_count * PAGE_SIZE) / 4;
+    if (paged_size > PAGED_ZONE_MAX) paged_size = PAGED_ZONE_MAX;
+    paged_size &= ~(uint64_t)(GRANULE_2MB - 1);
+    paged_first = buddy_count - paged_size / PAGE_SIZE;
+
+    for (int z = 0; z < 2; z++)
+        for (int o = 0; o <= BUDDY_MAX_ORDER; o++)
+            free_lists[z][o] = BUDDY_NONE;
+    for (uint64_t i = 0; i < buddy_count; i++)
+        buddy_pages[i] = (buddy_page){ BUDDY_NONE, BUDDY_NONE, 0 };
+
+    uint64_t i = buddy_meta_size / PAGE_SIZE;
+    while (i < buddy_count){
+        uint64_t zone_end = i < paged_first ? paged_first : buddy_count;
+        uint8_t order = BUDDY_MAX_ORDER;
+        while ((i & ((1ULL << order) - 1)) || i + (1ULL << order) > zone_end)
+            order--;
+        buddy_push(i, order);
+        i += 1ULL << order;
     }
+    kprintfv("[page_alloc] %i free pages, metadata %x bytes, paged zone %x bytes", buddy_free_count, buddy_meta_size, paged_size);
 }
 
+void page_allocator_paged_zone(uintptr_t *start, uint64_t *size){
+    *start = buddy_base + (uintptr_t)paged_first * PAGE_SIZE;
+    *size = (buddy_count - paged_first) * PAGE_SIZE;
+}
+
+uint64_t palloc_free_pages(){
+    return buddy_free_count;
+}
+
+static bool buddy_index(uintptr_t addr, uint32_t *idx){
+    if (addr < buddy_base || (addr & (PAGE_SIZE - 1))) return false;
+    uint64_t i = (addr - buddy_base) / PAGE_SIZE;
+    if (i >= buddy_count) return false;
+    *idx = i;
+    return true;
+}
+
+uint64_t palloc_size(void* ptr){
+    uint32_t idx;
+    if (!buddy_index((uintptr_t)ptr, &idx) || buddy_pages[idx].order != BUDDY_RUN) return 0;
+    return (uint64_t)buddy_pages[idx].next * PAGE_SIZE;
+}
+
+//The length comes from the run recorded by palloc, so size is only a sanity check and may be 0
 void pfree(void* ptr, uint64_t size) {
-    uint64_t addr = (uint64_t)ptr;
-    addr /= PAGE_SIZE;
-    uint64_t table_index = addr/64;
-    uint64_t table_offset = addr % 64;
-    mem_bitmap[table_index] &= ~(1ULL << table_offset);
+    uint32_t idx;
+    if (!buddy_index((uintptr_t)ptr, &idx)){
+        kprintfv("[page_alloc error] Freeing address %x outside of user RAM", (uintptr_t)ptr);
+        return;
+    }
+    if (buddy_pages[idx].order != BUDDY_RUN){
+        kprintfv("[page_alloc error] Freeing %x, which isn't the start of an allocation", (uintptr_t)ptr);
+        return;
+    }
+    uint64_t count = buddy_pages[idx].next;
+    if ((uint64_t)count_pages(size, PAGE_SIZE) > count)
+        kprintfv("[page_alloc error] Freeing %x bytes at %x, more than was allocated", size, (uintptr_t)ptr);
+#ifdef SECURE_MEMORY
+    memset(ptr, 0, count * PAGE_SIZE);
+#endif
+    //Still the caller's, so the blocks a DMA run was mapped with can be split without anyone using them
+    if (buddy_zone(idx) == ZONE_PAGED && count >= GRANULE_2MB / PAGE_SIZE)
+        release_dma_range((uintptr_t)ptr, count * PAGE_SIZE);
+    buddy_release(idx, count);
 }
 
 int count_pages(uint64_t i1,uint64_t i2){
     return (i1/i2) + (i1 % i2 > 0);
 }
 
+//Kernel memory falls back to the paged zone once the linear one is full, memory with other attributes never
+//comes from the linear zone
 void* palloc(uint64_t size, bool kernel, bool device, bool full) {
-    uint64_t start = count_pages(get_user_ram_start(),PAGE_SIZE);
-    uint64_t end = count_pages(get_user_ram_end(),PAGE_SIZE);
     uint64_t page_count = count_pages(size,PAGE_SIZE);
+    if (page_count == 0) page_count = 1;
+
+    bool paged = device || !kernel;
+    uint32_t idx = paged ? BUDDY_NONE : buddy_alloc_run(ZONE_LINEAR, page_count);
+    if (idx == BUDDY_NONE)
+        idx = buddy_alloc_run(ZONE_PAGED, page_count);
+    if (idx == BUDDY_NONE){
+        kprintfv("[page_alloc error] Could not allocate %x contiguous bytes", size);
+        return 0;
+    }
 
-    for (uint64_t i = start/64; i < end/64; i++) {
-        if (mem_bitmap[i] != UINT64_MAX) {
-            uint64_t inv = ~mem_bitmap[i];
-            uint64_t bit = __builtin_ctzll(inv);
-            do {
-                bool found = true;
-                for (uint64_t b = bit; b < bit + (page_count - 1); b++){
-                    if (!mem_bitmap[i] >> b & 1){
-                        bit += page_count;
-                        found = false;
-                    }
-                }
-                if (found) break;
-            } while (bit < 64);
-            if (bit == 64) continue;
-            
-            uintptr_t first_address = 0;
-            for (uint64_t j = 0; j < page_count; j++){
-                mem_bitmap[i] |= (1ULL << (bit + j));
-                uint64_t page_index = (i * 64) + (bit + j);
-                uintptr_t address = page_index * PAGE_SIZE;
-                if (!first_address) first_address = address;
-
-                if (device && kernel)
-                    register_device_memory(address, address);
-                else
-                    register_proc_memory(address, address, kernel);
-
-                if (!full) {
-                    mem_page* new_info = (mem_page*)address;
-                    new_info->next = NULL;
-                    new_info->free_list = NULL;
-                    new_info->next_free_mem_ptr = address + sizeof(mem_page);
-                    new_info->size = 0;
-                }
-            }
-
-            // kprintfv("[page_alloc] Final address %x", first_address);
-
-            return (void*)first_address;
+    //The linear map already has the entries a kernel allocation needs
+    uintptr_t first_address = buddy_base + (uintptr_t)idx * PAGE_SIZE;
+    if (device && kernel)
+        register_dma_range(first_address, first_address, page_count * PAGE_SIZE);
+    else if (buddy_zone(idx) == ZONE_PAGED) {
+        for (uint64_t j = 0; j < page_count; j++){
+            uintptr_t address = first_address + j * PAGE_SIZE;
+            register_proc_memory(address, address, kernel);
         }
     }
 
-    // kprintf("[page_alloc error] Could not allocate");
-    return 0;
+    if (!full) {
+        mem_page* new_info = (mem_page*)first_address;
+        memset(new_info, 0, sizeof(mem_page));
+        new_info->head = new_info;
+        new_info->tail = new_info;
+        new_info->next_free_mem_ptr = first_address + sizeof(mem_page);
+    }
+
+    // kprintfv("[page_alloc] Final address %x", first_address);
+
+    return (void*)first_address;
 }
 
 void mark_used(uintptr_t address, size_t pages)
@@ -105,90 +285,288 @@ void mark_used(uintptr_t address, size_t pages)
         // kprintf("[mark_used error] address %x not aligned", address);
         return;
     }
-    if (pages == 0) return;
-
-    uint64_t start = count_pages(get_user_ram_start(),PAGE_SIZE);
-
-    uint64_t page_index = (address / (PAGE_SIZE * 64)) - (start/64);
 
     for (size_t j = 0; j < pages; j++) {
-        uint64_t idx = page_index + j;
-        uint64_t i = idx / 64;
-        uint64_t bit  = idx % 64;
-
-        mem_bitmap[i] |= (1ULL << bit);
+        uint32_t idx;
+        if (buddy_index(address + j * PAGE_SIZE, &idx))
+            buddy_reserve(idx);
     }
 }
 
-void* kalloc(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device){
-    size = (size + alignment - 1) & ~(alignment - 1);
+#ifdef DEBUG
 
-    // kprintfv("[in_page_alloc] Requested size: %x", size);
+#define SELFTEST_SLOTS 256
+#define SELFTEST_ROUNDS 8192
+#define SELFTEST_MAX_ORDER 9
 
-    mem_page *info = (mem_page*)page;
+static uint32_t selftest_seed = 0x12345678;
 
-    if (size >= PAGE_SIZE){
-        // kprintfv("[page_alloc] Allocating full page for %x",size);
-        void *first_addr = 0;
-        for (uint64_t i = 0; i < size; i += PAGE_SIZE){
-            void* ptr = palloc(PAGE_SIZE, kernel, device, true);
-            memset((void*)ptr, 0, PAGE_SIZE);
-            if (!first_addr) first_addr = ptr;
+static uint32_t selftest_rand(){
+    selftest_seed = selftest_seed * 1103515245 + 12345;
+    return selftest_seed >> 8;
+}
+
+//Random allocations and frees of blocks up to 2MB, checking they're aligned to their size and never overlap,
+//then a fragmentation pass that checks single page holes can't be handed out as bigger blocks, odd sized
+//runs that must take exactly their length, and that freeing everything coalesces back to the starting state
+void page_allocator_selftest(){
+    uint64_t free_before = buddy_free_count;
+    uint32_t blocks[SELFTEST_SLOTS];
+    uint8_t orders[SELFTEST_SLOTS];
+    for (int i = 0; i < SELFTEST_SLOTS; i++) blocks[i] = BUDDY_NONE;
+
+    for (int r = 0; r < SELFTEST_ROUNDS; r++){
+        int slot = selftest_rand() % SELFTEST_SLOTS;
+        if (blocks[slot] != BUDDY_NONE){
+            buddy_free(blocks[slot]);
+            blocks[slot] = BUDDY_NONE;
+            continue;
         }
-        //TODO: we're not keeping track of this size
-        return first_addr;
+        uint8_t order = selftest_rand() % (SELFTEST_MAX_ORDER + 1);
+        uint32_t idx = buddy_alloc(ZONE_LINEAR, order);
+        if (idx == BUDDY_NONE) continue;
+        if (idx & ((1U << order) - 1))
+            panic_with_info("[page_alloc selftest] Misaligned block", idx);
+        for (int i = 0; i < SELFTEST_SLOTS; i++){
+            if (blocks[i] == BUDDY_NONE) continue;
+            if (idx < blocks[i] + (1U << orders[i]) && blocks[i] < idx + (1U << order))
+                panic_with_info("[page_alloc selftest] Overlapping blocks", idx);
+        }
+        blocks[slot] = idx;
+        orders[slot] = order;
+    }
+    for (int i = 0; i < SELFTEST_SLOTS; i++)
+        if (blocks[i] != BUDDY_NONE) buddy_free(blocks[i]);
+    if (buddy_free_count != free_before)
+        panic_with_info("[page_alloc selftest] Pages leaked by stress pass", free_before - buddy_free_count);
+
+    for (int i = 0; i < SELFTEST_SLOTS; i++)
+        blocks[i] = buddy_alloc(ZONE_LINEAR, 0);
+    for (int i = 0; i < SELFTEST_SLOTS; i += 2)
+        if (blocks[i] != BUDDY_NONE) buddy_free(blocks[i]);
+    uint32_t pair = buddy_alloc(ZONE_LINEAR, 1);
+    for (int i = 1; i < SELFTEST_SLOTS; i += 2)
+        if (blocks[i] != BUDDY_NONE && pair != BUDDY_NONE && blocks[i] >= pair && blocks[i] < pair + 2)
+            panic_with_info("[page_alloc selftest] Order 1 block built around a page still in use", pair);
+    if (pair != BUDDY_NONE) buddy_free(pair);
+    for (int i = 1; i < SELFTEST_SLOTS; i += 2)
+        if (blocks[i] != BUDDY_NONE) buddy_free(blocks[i]);
+    if (buddy_free_count != free_before)
+        panic_with_info("[page_alloc selftest] Pages leaked by fragmentation pass", free_before - buddy_free_count);
+
+    static const uint64_t runs[] = { 3, 5, 511, 513, 700, 1500 };
+    for (int i = 0; i < 6; i++){
+        uint64_t free_pages = buddy_free_count;
+        blocks[i] = buddy_alloc_run(ZONE_LINEAR, runs[i]);
+        if (blocks[i] != BUDDY_NONE && free_pages - buddy_free_count != runs[i])
+            panic_with_info("[page_alloc selftest] Run not trimmed to its length", runs[i]);
     }
+    for (int i = 0; i < 6; i++)
+        if (blocks[i] != BUDDY_NONE) buddy_release(blocks[i], buddy_pages[blocks[i]].next);
+    if (buddy_free_count != free_before)
+        panic_with_info("[page_alloc selftest] Pages leaked by trimmed runs", free_before - buddy_free_count);
 
-    FreeBlock** curr = &info->free_list;
-    while (*curr) {
-        if ((*curr)->size >= size) {
-            // kprintfv("[in_page_alloc] Reusing free block at %x",(uintptr_t)*curr);
+    uint32_t big = buddy_alloc(ZONE_LINEAR, 9);
+    if (big == BUDDY_NONE)
+        panic("[page_alloc selftest] Freed pages did not coalesce into a 2MB block");
+    buddy_free(big);
 
-            uint64_t result = (uint64_t)*curr;
-            *curr = (*curr)->next;
-            memset((void*)result, 0, size);
-            info->size += size;
-            return (void*)result;
-        }
-        // kprintfv("-> %x",(uintptr_t)&(*curr)->next);
-        curr = &(*curr)->next;
+    kprintf("[page_alloc selftest] Passed, %i pages free", buddy_free_count);
+}
+
+#endif
+
+//Pages zeroed ahead of time by the idle loop, handed out to single page zeroed allocations
+#define ZERO_POOL_SIZE 64
+
+static uintptr_t zero_pool[ZERO_POOL_SIZE];
+static uint32_t zero_pool_count;
+static uint64_t zero_pool_hits;
+static uint64_t zero_pool_misses;
+
+//Pool pages are in the linear zone, so they only serve kernel memory. The rest comes from the paged zone
+static void* zero_pool_take(bool kernel, bool device){
+    if (device || !kernel) return 0;
+    if (!zero_pool_count){
+        zero_pool_misses++;
+        return 0;
     }
+    zero_pool_hits++;
+    return (void*)zero_pool[--zero_pool_count];
+}
 
-    // kprintfv("[in_page_alloc] Current next pointer %x",info->next_free_mem_ptr);
+//Runs from the idle loop without the kernel lock. The lock is only taken, with interrupts masked so the
+//IRQ return path can't drop it, to move a page in or out of the allocator. The zeroing itself runs unlocked
+bool zero_pool_refill(){
+    if (zero_pool_count >= ZERO_POOL_SIZE) return false;
+
+    asm volatile ("msr daifset, #2");
+    kernel_lock();
+    void *page = palloc(PAGE_SIZE, true, false, true);
+    kernel_unlock();
+    asm volatile ("msr daifclr, #2");
+    if (!page) return false;
+
+    memset(page, 0, PAGE_SIZE);
+
+    asm volatile ("msr daifset, #2");
+    kernel_lock();
+    if (zero_pool_count < ZERO_POOL_SIZE)
+        zero_pool[zero_pool_count++] = (uintptr_t)page;
+    else
+        pfree(page, PAGE_SIZE);
+    kernel_unlock();
+    asm volatile ("msr daifclr, #2");
+    return true;
+}
+
+void zero_pool_stats(uint64_t *pooled, uint64_t *hits, uint64_t *misses){
+    *pooled = zero_pool_count;
+    *hits = zero_pool_hits;
+    *misses = zero_pool_misses;
+}
 
-    info->next_free_mem_ptr = (info->next_free_mem_ptr + alignment - 1) & ~(alignment - 1);
+//Only live blocks are counted. Callers free with 0 as often as with the size they asked for, so the bytes lost
+//to rounding up can't be tracked here, the slab caches report those for their fixed sizes
+static uint64_t class_live[KALLOC_CLASSES];
 
-    // kprintfv("[in_page_alloc] Aligned next pointer %x",info->next_free_mem_ptr);
+static int kalloc_class(uint64_t size){
+    int c = 0;
+    while ((uint64_t)(KALLOC_MIN_CLASS << c) < size) c++;
+    return c;
+}
+
+static inline uint8_t* kalloc_class_slot(uintptr_t block, uint8_t *shift){
+    mem_page *page = (mem_page*)(block & ~(PAGE_SIZE - 1));
+    uint64_t slot = (block & (PAGE_SIZE - 1)) / KALLOC_MIN_CLASS;
+    *shift = (slot & 1) * 4;
+    return &page->classes[slot / 2];
+}
 
-    if (info->next_free_mem_ptr + size > (((uintptr_t)page) + PAGE_SIZE)) {
-        if (!info->next)
-            info->next = palloc(PAGE_SIZE, kernel, device, false);
-        // kprintfv("[in_page_alloc] Page full. Moving to %x",(uintptr_t)info->next);
-        return kalloc(info->next, size, alignment, kernel, device);
+static void kalloc_mark(uintptr_t block, uint8_t mark){
+    uint8_t shift;
+    uint8_t *slot = kalloc_class_slot(block, &shift);
+    *slot = (*slot & ~(0xF << shift)) | (mark << shift);
+}
+
+//Class of the live block at ptr, -1 if no block starts there
+static int kalloc_marked_class(uintptr_t block){
+    uint8_t shift;
+    uint8_t *slot = kalloc_class_slot(block, &shift);
+    return ((*slot >> shift) & 0xF) - 1;
+}
+
+void kalloc_class_stats(int c, uint64_t *live){
+    *live = class_live[c];
+}
+
+//Small blocks are served from per size class free lists kept in the first page of the chain, or carved
+//from its last page. Anything over the largest class, or needing page alignment, gets whole pages
+static void* kalloc_internal(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device, bool zero){
+    if (size > KALLOC_MAX_CLASS || alignment >= PAGE_SIZE){
+        // kprintfv("[page_alloc] Allocating full pages for %x",size);
+        if (zero && size <= PAGE_SIZE){
+            void *pooled = zero_pool_take(kernel, device);
+            if (pooled) return pooled;
+        }
+        void *first_addr = palloc(size, kernel, device, true);
+        if (first_addr && zero)
+            memset(first_addr, 0, palloc_size(first_addr));
+        return first_addr;
     }
 
-    uint64_t result = info->next_free_mem_ptr;
-    info->next_free_mem_ptr += size;
+    mem_page *head = ((mem_page*)page)->head;
+    int c = kalloc_class(size);
+    uint64_t block = KALLOC_MIN_CLASS << c;
+    if (alignment < ALIGN_16B) alignment = ALIGN_16B;
+
+    uintptr_t result;
+    FreeBlock *free = head->free_lists[c];
+    if (free && ((uintptr_t)free & (alignment - 1)) == 0){
+        // kprintfv("[in_page_alloc] Reusing free block at %x",(uintptr_t)free);
+        head->free_lists[c] = free->next;
+        result = (uintptr_t)free;
+    } else {
+        mem_page *tail = head->tail;
+        result = (tail->next_free_mem_ptr + alignment - 1) & ~((uint64_t)alignment - 1);
+        if (result + block > (uintptr_t)tail + PAGE_SIZE){
+            if (!tail->next){
+                tail->next = palloc(PAGE_SIZE, kernel, device, false);
+                if (!tail->next) return 0;
+                tail->next->head = head;
+            }
+            // kprintfv("[in_page_alloc] Page full. Moving to %x",(uintptr_t)tail->next);
+            tail = tail->next;
+            head->tail = tail;
+            result = (tail->next_free_mem_ptr + alignment - 1) & ~((uint64_t)alignment - 1);
+        }
+        tail->next_free_mem_ptr = result + block;
+    }
 
     // kprintfv("[in_page_alloc] Allocated address %x",result);
 
-    memset((void*)result, 0, size);
-    info->size += size;
+    ((mem_page*)(result & ~(PAGE_SIZE - 1)))->size += block;
+    kalloc_mark(result, c + 1);
+    class_live[c]++;
+    if (zero)
+        memset((void*)result, 0, size);
     return (void*)result;
 }
 
+void* kalloc(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device){
+    return kalloc_internal(page, size, alignment, kernel, device, true);
+}
+
+void* kalloc_zeroed(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device){
+    return kalloc_internal(page, size, alignment, kernel, device, true);
+}
+
+void* kalloc_uninit(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device){
+    return kalloc_internal(page, size, alignment, kernel, device, false);
+}
+
+//Blocks carved from a page chain never start at a page boundary since the page header is there,
+//so a page aligned pointer must have come from the whole page path, which tracks its own length
 void kfree(void* ptr, uint64_t size) {
     // kprintfv("[page_alloc_free] Freeing block at %x size %x",(uintptr_t)ptr, size);
 
-    memset((void*)ptr,0,size);
+    if (((uintptr_t)ptr & (PAGE_SIZE - 1)) == 0){
+        pfree(ptr, size);
+        return;
+    }
 
-    mem_page *page = (mem_page *)(((uintptr_t)ptr) & ~0xFFF);
+    //The class comes from the page rather than the caller. A pointer that isn't a live block, or a size bigger than
+    //its block, would corrupt the free lists
+    int c = kalloc_marked_class((uintptr_t)ptr);
+    uint64_t block = c < 0 ? 0 : KALLOC_MIN_CLASS << c;
+    if (c < 0 || size > block){
+        kprintf("[page_alloc error] Freeing %x bytes at %x, which is not a live block that size", size, (uintptr_t)ptr);
+        return;
+    }
 
-    FreeBlock* block = (FreeBlock*)ptr;
-    block->size = size;
-    block->next = page->free_list;
-    page->free_list = block;
-    page->size -= size;
+#ifdef SECURE_MEMORY
+    memset((void*)ptr,0,block);
+#endif
+
+    mem_page *page = (mem_page *)(((uintptr_t)ptr) & ~(PAGE_SIZE - 1));
+    kalloc_mark((uintptr_t)ptr, 0);
+
+    FreeBlock* free = (FreeBlock*)ptr;
+    free->size = block;
+    free->next = page->head->free_lists[c];
+    page->head->free_lists[c] = free;
+    page->size -= block;
+    class_live[c]--;
+}
+
+//Live blocks stay counted in the class stats, there's no telling their classes apart without walking them
+void kalloc_release(void *page){
+    mem_page *current = ((mem_page*)page)->head;
+    while (current){
+        mem_page *next = current->next;
+        pfree(current, PAGE_SIZE);
+        current = next;
+    }
 }
 
 void free_sized(sizedptr ptr){
@@ -14,12 +14,31 @@ void page_allocator_init();
 #ifdef __cplusplus
 extern "C" {
 #endif
+//Allocates physically contiguous pages. pfree returns the whole run, so its size may be 0
 void* palloc(uint64_t size, bool kernel, bool device, bool full);
 void pfree(void* ptr, uint64_t size);
+uint64_t palloc_size(void* ptr);
 void mark_used(uintptr_t address, size_t pages);
+uint64_t palloc_free_pages();
+//Range at the top of user RAM the MMU maps in pages, see palloc
+void page_allocator_paged_zone(uintptr_t *start, uint64_t *size);
+#ifdef DEBUG
+void page_allocator_selftest();
+#endif
 
+//kalloc zeroes the block like kalloc_zeroed. kalloc_uninit is for buffers that are about to be overwritten
 void* kalloc(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device);
+void* kalloc_zeroed(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device);
+void* kalloc_uninit(void *page, uint64_t size, uint16_t alignment, bool kernel, bool device);
+//Allocations over KALLOC_MAX_CLASS are contiguous pages that know their own length, so size may be 0 for them.
+//Smaller blocks are freed by the class kalloc recorded for them, size is only checked against it
 void kfree(void* ptr, uint64_t size);
+//Frees every page of the chain that starts at page, along with any blocks still in it
+void kalloc_release(void *page);
+void kalloc_class_stats(int c, uint64_t *live);
+
+bool zero_pool_refill();
+void zero_pool_stats(uint64_t *pooled, uint64_t *hits, uint64_t *misses);
 
 int count_pages(uint64_t i1,uint64_t i2);
 
@@ -0,0 +1,60 @@
+#include "slab.h"
+#include "page_allocator.h"
+#include "console/kio.h"
+#include "std/memfunctions.h"
+
+static kmem_cache *caches;
+
+static uint32_t slot_size(kmem_cache *cache){
+    uint32_t size = cache->object_size < sizeof(FreeBlock) ? sizeof(FreeBlock) : cache->object_size;
+    uint32_t alignment = cache->alignment < ALIGN_16B ? ALIGN_16B : cache->alignment;
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+void* kmem_cache_alloc(kmem_cache *cache){
+    uint32_t slot = slot_size(cache);
+    uintptr_t result;
+    if (cache->free_list){
+        result = (uintptr_t)cache->free_list;
+        cache->free_list = cache->free_list->next;
+    } else {
+        if (cache->next_free + slot > cache->limit){
+            void *page = palloc(PAGE_SIZE, true, cache->device, true);
+            if (!page) return 0;
+            if (!cache->pages){
+                cache->next = caches;
+                caches = cache;
+            }
+            cache->pages++;
+            cache->next_free = (uintptr_t)page;
+            cache->limit = (uintptr_t)page + PAGE_SIZE;
+        }
+        result = cache->next_free;
+        cache->next_free += slot;
+    }
+    cache->live++;
+    memset((void*)result, 0, cache->object_size);
+    return (void*)result;
+}
+
+void kmem_cache_free(kmem_cache *cache, void *ptr){
+    if (!ptr) return;
+#ifdef SECURE_MEMORY
+    memset(ptr, 0, cache->object_size);
+#endif
+    FreeBlock *block = (FreeBlock*)ptr;
+    block->size = slot_size(cache);
+    block->next = cache->free_list;
+    cache->free_list = block;
+    cache->live--;
+}
+
+void kmem_print_stats(){
+    for (kmem_cache *cache = caches; cache; cache = cache->next)
+        kprintf("[slab] %s: %i live of %i bytes, %i pages, %i bytes wasted", (uintptr_t)cache->name, cache->live, cache->object_size, cache->pages, cache->pages * PAGE_SIZE - cache->live * cache->object_size);
+    for (int c = 0; c < KALLOC_CLASSES; c++){
+        uint64_t live;
+        kalloc_class_stats(c, &live);
+        kprintf("[kalloc] %i bytes: %i live, %i bytes held", KALLOC_MIN_CLASS << c, live, live * (KALLOC_MIN_CLASS << c));
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "types.h"
+#include "memory/memory_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Cache of fixed size objects for allocations that are made and freed constantly.
+//Slab pages are taken from palloc the first time they're needed, freed objects are reused before carving new ones
+typedef struct kmem_cache {
+    const char *name;
+    uint32_t object_size;
+    uint16_t alignment;
+    bool device;
+    FreeBlock *free_list;
+    uintptr_t next_free;
+    uintptr_t limit;
+    uint64_t live;
+    uint64_t pages;
+    struct kmem_cache *next;
+} kmem_cache;
+
+#define KMEM_CACHE(name, size, alignment, device) { name, size, alignment, device, 0, 0, 0, 0, 0, 0 }
+
+void* kmem_cache_alloc(kmem_cache *cache);
+void kmem_cache_free(kmem_cache *cache, void *ptr);
+
+//Prints live objects and wasted bytes for every slab cache, and live blocks for every kalloc size class
+void kmem_print_stats();
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,12 +4,17 @@
 #include "pci.h"
 #include "syscalls/syscalls.h"
 #include "memory/page_allocator.h"
+#include "memory/slab.h"
 #include "std/memfunctions.h"
 
 #define RECEIVE_QUEUE 0
 #define TRANSMIT_QUEUE 1
 //TODO: review this number
 #define MAX_size 0x1000
+//Outgoing frames up to an MTU plus the virtio header fit a slot, anything bigger falls back to kalloc
+#define PACKET_SLOT_SIZE 0x800
+
+static kmem_cache packet_cache = KMEM_CACHE("virtio_net_packet", PACKET_SLOT_SIZE, ALIGN_64B, true);
 
 #define kprintfv(fmt, ...) \
     ({ \
@@ -120,7 +125,9 @@ void VirtioNetDriver::get_mac(network_connection_ctx *context){
 }
 
 sizedptr VirtioNetDriver::allocate_packet(size_t size){
-    return (sizedptr){(uintptr_t)kalloc(vnp_net_dev.memory_page, size + header_size, ALIGN_64B, true, true),size + header_size};
+    if (size + header_size > PACKET_SLOT_SIZE)
+        return (sizedptr){(uintptr_t)kalloc(vnp_net_dev.memory_page, size + header_size, ALIGN_64B, true, true),size + header_size};
+    return (sizedptr){(uintptr_t)kmem_cache_alloc(&packet_cache),size + header_size};
 }
 
 sizedptr VirtioNetDriver::handle_receive_packet(){
@@ -165,8 +172,11 @@ void VirtioNetDriver::handle_sent_packet(){
         last_used_sent_idx = new_idx;
         struct virtq_used_elem* e = &used->ring[used_ring_index];
         uint32_t desc_index = e->id;
-        uint32_t len = e->len;
-        kfree((void*)desc[desc_index].addr, len);
+        uint32_t len = desc[desc_index].len;
+        if (len > PACKET_SLOT_SIZE)
+            kfree((void*)desc[desc_index].addr, len);
+        else
+            kmem_cache_free(&packet_cache, (void*)desc[desc_index].addr);
         return;
     }
 }
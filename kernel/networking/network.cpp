@@ -27,6 +27,11 @@ bool network_unbind_port(uint16_t port, uint16_t process){
     return dispatch->unbind_port(port, process);
 }
 
+void network_unbind_process(uint16_t process){
+    if (dispatch)
+        dispatch->unbind_process(process);
+}
+
 bool network_bind_port_current(uint16_t port){
     return dispatch->bind_port(port, get_current_proc_pid());
 }
@@ -14,6 +14,8 @@ void network_handle_download_interrupt();
 void network_handle_upload_interrupt();
 bool network_bind_port(uint16_t port, uint16_t process);
 bool network_unbind_port(uint16_t port, uint16_t process);
+//Releases every port still bound to a process that's stopping
+void network_unbind_process(uint16_t process);
 void network_send_packet(NetProtocol protocol, uint16_t port, network_connection_ctx *destination, void* payload, uint16_t payload_len);
 
 bool network_bind_port_current(uint16_t port);
@@ -3,6 +3,7 @@
 #include "net/network_types.h"
 #include "console/kio.h"
 #include "process/scheduler.h"
+#include "process/process_events.h"
 #include "net/udp.h"
 #include "net/tcp.h"
 #include "net/dhcp.h"
@@ -19,6 +20,8 @@ NetworkDispatch::NetworkDispatch(){
     for (uint16_t i = 0; i < UINT16_MAX; i++)
         ports[i] = UINT16_MAX;
     context = (network_connection_ctx) {0};
+    driver = 0;
+    loopback_page = 0;
 }
 
 NetDriver* NetworkDispatch::select_driver(){
@@ -33,77 +36,94 @@ bool NetworkDispatch::init(){
     return false;
 }
 
+//Processes count their ports, so one that never bound any doesn't need a scan when it stops
 bool NetworkDispatch::bind_port(uint16_t port, uint16_t process){
     if (ports[port] != UINT16_MAX) return false;
     ports[port] = process;
+    if (process_t *proc = get_proc_by_pid(process))
+        proc->bound_ports++;
     return true;
 }
 
 bool NetworkDispatch::unbind_port(uint16_t port, uint16_t process){
     if (ports[port] != process) return false;
     ports[port] = UINT16_MAX;
+    process_t *proc = get_proc_by_pid(process);
+    if (proc && proc->bound_ports)
+        proc->bound_ports--;
     return true;
 }
 
-void NetworkDispatch::handle_download_interrupt(){
-    if (driver){
-        sizedptr packet = driver->handle_receive_packet();
-        bool need_free = true;
-        uintptr_t ptr = packet.ptr;
-        if (ptr){
-            eth_hdr_t *eth = (eth_hdr_t*)ptr;
-            uint16_t ethtype = eth_parse_packet_type(ptr);
-            ptr += sizeof(eth_hdr_t);
-            if (ethtype == 0x806){
-                arp_hdr_t *arp = (arp_hdr_t*)ptr;
-                if (arp_should_handle(arp, get_context()->ip)){
-                    kprintf("Received an ARP request");
-                    bool req = 0;
-                    network_connection_ctx conn;
-                    arp_populate_response(&conn, arp);
-                    send_packet(ARP, 0, &conn, &req, 1);
-                }
-                //TODO: Should also look for responses to our own queries
-            } else if (ethtype == 0x800){//IPV4
-                ipv4_hdr_t *ipv4 = (ipv4_hdr_t*)ptr;
-                uint8_t protocol = ipv4_get_protocol(ptr);
-                ptr += sizeof(ipv4_hdr_t);
-                if (protocol == 0x11 || protocol == 0x06){
-                    uint16_t port = udp_parse_packet(ptr);
-                    if (ports[port] != UINT16_MAX){
-                        process_t *proc = get_proc_by_pid(ports[port]);
-                        if (!proc)
-                            unbind_port(port, ports[port]);
-                        else {
-                            packet_buffer_t* buf = &proc->packet_buffer;
-                            uint32_t next_index = (buf->write_index + 1) % PACKET_BUFFER_CAPACITY;
-
-                            buf->entries[buf->write_index] = packet;
-                            buf->write_index = next_index;
-
-                            need_free = false;
-
-                            if (buf->write_index == buf->read_index)
-                                buf->read_index = (buf->read_index + 1) % PACKET_BUFFER_CAPACITY;
-                        }
-                    }
-                } else if (protocol == 0x1) {
-                    icmp_data data = (icmp_data){
-                        .response = true
-                    };
-                    network_connection_ctx conn;
-                    icmp_packet *icmp = (icmp_packet*)ptr;
-                    data.seq = icmp_get_sequence(icmp);
-                    data.id = icmp_get_id(icmp);
-                    icmp_copy_payload(&data.payload, icmp);
-                    ipv4_populate_response(&conn, eth, ipv4);
-                    send_packet(ICMP, 0, &conn, &data, sizeof(icmp_data));
+void NetworkDispatch::unbind_process(uint16_t process){
+    for (uint16_t i = 0; i < UINT16_MAX; i++)
+        if (ports[i] == process)
+            ports[i] = UINT16_MAX;
+}
+
+//Hands a received ethernet frame to whoever handles it. Returns true if the packet was queued to a process,
+//which then owns it
+bool NetworkDispatch::handle_packet(sizedptr packet){
+    bool queued = false;
+    uintptr_t ptr = packet.ptr;
+    if (!ptr) return false;
+    eth_hdr_t *eth = (eth_hdr_t*)ptr;
+    uint16_t ethtype = eth_parse_packet_type(ptr);
+    ptr += sizeof(eth_hdr_t);
+    if (ethtype == 0x806){
+        arp_hdr_t *arp = (arp_hdr_t*)ptr;
+        if (arp_should_handle(arp, get_context()->ip)){
+            kprintf("Received an ARP request");
+            bool req = 0;
+            network_connection_ctx conn;
+            arp_populate_response(&conn, arp);
+            send_packet(ARP, 0, &conn, &req, 1);
+        }
+        //TODO: Should also look for responses to our own queries
+    } else if (ethtype == 0x800){//IPV4
+        ipv4_hdr_t *ipv4 = (ipv4_hdr_t*)ptr;
+        uint8_t protocol = ipv4_get_protocol(ptr);
+        ptr += sizeof(ipv4_hdr_t);
+        if (protocol == 0x11 || protocol == 0x06){
+            uint16_t port = udp_parse_packet(ptr);
+            if (ports[port] != UINT16_MAX){
+                process_t *proc = get_proc_by_pid(ports[port]);
+                if (!proc)
+                    unbind_port(port, ports[port]);
+                else if (packet_buffer_t* buf = get_packet_buffer(proc)) {
+                    uint32_t next_index = (buf->write_index + 1) % PACKET_BUFFER_CAPACITY;
+
+                    buf->entries[buf->write_index] = packet;
+                    buf->write_index = next_index;
+
+                    queued = true;
+
+                    if (buf->write_index == buf->read_index)
+                        buf->read_index = (buf->read_index + 1) % PACKET_BUFFER_CAPACITY;
+
+                    process_signal_event(proc, EVENT_PACKET);
                 }
             }
+        } else if (protocol == 0x1) {
+            icmp_data data = (icmp_data){
+                .response = true
+            };
+            network_connection_ctx conn;
+            icmp_packet *icmp = (icmp_packet*)ptr;
+            data.seq = icmp_get_sequence(icmp);
+            data.id = icmp_get_id(icmp);
+            icmp_copy_payload(&data.payload, icmp);
+            ipv4_populate_response(&conn, eth, ipv4);
+            send_packet(ICMP, 0, &conn, &data, sizeof(icmp_data));
         }
-        if (need_free){
+    }
+    return queued;
+}
+
+void NetworkDispatch::handle_download_interrupt(){
+    if (driver){
+        sizedptr packet = driver->handle_receive_packet();
+        if (!handle_packet(packet))
             free_sized(packet);
-        }
     }
 }
 
@@ -113,48 +133,71 @@ void NetworkDispatch::handle_upload_interrupt(){
 
 bool NetworkDispatch::read_packet(sizedptr *Packet, uint16_t process){
     process_t *proc = get_proc_by_pid(process);
-    if (proc->packet_buffer.read_index == proc->packet_buffer.write_index) return false;
+    if (!proc || !proc->packet_buffer) return false;
+    packet_buffer_t *buf = proc->packet_buffer;
+    if (buf->read_index == buf->write_index) return false;
 
-    sizedptr original = proc->packet_buffer.entries[proc->packet_buffer.read_index];
+    sizedptr original = buf->entries[buf->read_index];
     
-    uintptr_t copy = (uintptr_t)kalloc((void*)get_current_heap(), original.size, ALIGN_16B, get_current_privilege(), false);
+    uintptr_t copy = (uintptr_t)process_alloc(get_current_proc(), original.size, ALIGN_16B, false);
     memcpy((void*)copy,(void*)original.ptr,original.size);
     Packet->ptr = copy;
     Packet->size = original.size;
     free_sized(original);
-    proc->packet_buffer.read_index = (proc->packet_buffer.read_index + 1) % PACKET_BUFFER_CAPACITY;
+    buf->read_index = (buf->read_index + 1) % PACKET_BUFFER_CAPACITY;
     return true;
 }
 
+//127.0.0.0/8 and our own address
+bool NetworkDispatch::is_loopback(uint32_t ip){
+    return (ip >> 24) == 127 || (context.ip && ip == context.ip);
+}
+
+//Loopback frames have no driver header and are freed with free_sized by whoever reads them
+sizedptr NetworkDispatch::allocate_packet(size_t size){
+    if (!loopback_page)
+        loopback_page = palloc(PAGE_SIZE, true, false, false);
+    return (sizedptr){(uintptr_t)kalloc(loopback_page, size, ALIGN_64B, true, false), size};
+}
+
+//UDP and TCP for a loopback address never reach the driver, they're handed straight back in as if just received
 void NetworkDispatch::send_packet(NetProtocol protocol, uint16_t port, network_connection_ctx *destination, void* payload, uint16_t payload_len){
+    bool loopback = (protocol == UDP || protocol == TCP) && is_loopback(destination->ip);
+    if (!loopback && !driver) return;
+    uint16_t header_size = loopback ? 0 : driver->header_size;
     sizedptr packet_buffer;
+    size_t size;
     switch (protocol) {
         case UDP:
-            packet_buffer = driver->allocate_packet(sizeof(eth_hdr_t) + sizeof(ipv4_hdr_t) + sizeof(udp_hdr_t) + payload_len);
+            size = sizeof(eth_hdr_t) + sizeof(ipv4_hdr_t) + sizeof(udp_hdr_t) + payload_len;
+            packet_buffer = loopback ? allocate_packet(size) : driver->allocate_packet(size);
             context.port = port;
-            create_udp_packet(packet_buffer.ptr + driver->header_size, context, *destination, (sizedptr){(uintptr_t)payload, payload_len});
+            create_udp_packet(packet_buffer.ptr + header_size, context, *destination, (sizedptr){(uintptr_t)payload, payload_len});
         break;
         case DHCP:
             packet_buffer = driver->allocate_packet(DHCP_SIZE);
-            create_dhcp_packet(packet_buffer.ptr + driver->header_size, (dhcp_request*)payload);
+            create_dhcp_packet(packet_buffer.ptr + header_size, (dhcp_request*)payload);
             break;
         case ARP:
             packet_buffer = driver->allocate_packet(sizeof(eth_hdr_t) + sizeof(arp_hdr_t));
-            create_arp_packet(packet_buffer.ptr + driver->header_size, context.mac, context.ip, destination->mac, destination->ip, *(bool*)payload);
+            create_arp_packet(packet_buffer.ptr + header_size, context.mac, context.ip, destination->mac, destination->ip, *(bool*)payload);
             break;
         case ICMP:
             packet_buffer = driver->allocate_packet(sizeof(eth_hdr_t) + sizeof(ipv4_hdr_t) + sizeof(icmp_packet));
-            create_icmp_packet(packet_buffer.ptr + driver->header_size, context, *destination, (icmp_data*)payload);
+            create_icmp_packet(packet_buffer.ptr + header_size, context, *destination, (icmp_data*)payload);
             break;
         case TCP:
             tcp_data *data = (tcp_data*)payload;
-            packet_buffer = driver->allocate_packet(sizeof(eth_hdr_t) + sizeof(ipv4_hdr_t) + sizeof(tcp_hdr_t) + data->options.size + data->payload.size);
+            size = sizeof(eth_hdr_t) + sizeof(ipv4_hdr_t) + sizeof(tcp_hdr_t) + data->options.size + data->payload.size;
+            packet_buffer = loopback ? allocate_packet(size) : driver->allocate_packet(size);
             context.port = port;
-            create_tcp_packet(packet_buffer.ptr + driver->header_size, context, *destination, (sizedptr){(uintptr_t)data, sizeof(tcp_data)});
+            create_tcp_packet(packet_buffer.ptr + header_size, context, *destination, (sizedptr){(uintptr_t)data, sizeof(tcp_data)});
             break;
     }
-    if (driver)
+    if (!loopback)
         driver->send_packet(packet_buffer);
+    else if (!handle_packet(packet_buffer))
+        free_sized(packet_buffer);
 }
 
 network_connection_ctx* NetworkDispatch::get_context(){
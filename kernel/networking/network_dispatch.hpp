@@ -11,6 +11,7 @@ public:
     bool init();
     bool bind_port(uint16_t port, uint16_t process);
     bool unbind_port(uint16_t port, uint16_t process);
+    void unbind_process(uint16_t process);
     void handle_upload_interrupt();
     void handle_download_interrupt();
     //TODO: use sizedptr
@@ -25,6 +26,10 @@ private:
 
     NetDriver* select_driver();
 
+    bool handle_packet(sizedptr packet);
+    bool is_loopback(uint32_t ip);
+
     sizedptr allocate_packet(size_t size);
     network_connection_ctx context;
+    void *loopback_page;
 };
\ No newline at end of file
@@ -31,7 +31,7 @@ bool find_server(){
 
     sizedptr pack;
 
-    while (!read_packet(&pack));
+    while (!read_packet_wait(&pack, 0));
 
     memcpy((void*)&server.mac, (void*)eth_get_source(pack.ptr), 6);
 
@@ -84,7 +84,7 @@ uint32_t negotiate_dhcp(){
     dhcp_packet *payload;
 
     for (int i = 5; i >= 0; i--){
-        while (!read_packet(&ptr));//TODO. Timeout. Opt
+        while (!read_packet_wait(&ptr, 0));//TODO. Timeout. Opt
         kprintf("Received DHCP response");
         payload = dhcp_parse_packet_payload(ptr.ptr);
         uint16_t opt_index = dhcp_parse_option(payload, 53);
@@ -110,7 +110,7 @@ uint32_t negotiate_dhcp(){
     send_packet(DHCP, 53, ctx, &request, sizeof(dhcp_request));
 
     for (int i = 5; i >= 0; i--){
-        while (!read_packet(&ptr));
+        while (!read_packet_wait(&ptr, 0));
         kprintf("Received DHCP response");//TODO. Timeout. Opt
         payload = dhcp_parse_packet_payload(ptr.ptr);
         uint16_t opt_index = dhcp_parse_option(payload, 53);
@@ -146,5 +146,7 @@ void dhcp_daemon(){
 }
 
 process_t* launch_net_process(){
-    return create_kernel_process("dhcp_daemon",dhcp_daemon);
+    process_t *proc = create_kernel_process("dhcp_daemon",dhcp_daemon);
+    if (proc) set_process_priority(proc, PRIORITY_DRIVER);
+    return proc;
 }
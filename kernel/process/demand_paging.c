@@ -0,0 +1,177 @@
+#include "demand_paging.h"
+#include "process/process.h"
+#include "memory/page_allocator.h"
+#include "memory/mmu.h"
+#include "std/memfunctions.h"
+
+#define ESR_EC(esr) (((esr) >> 26) & 0x3F)
+#define ESR_FNV (1 << 10)
+#define DFSC_TRANSLATION 0b000100
+
+//Data aborts from EL0 or EL1 on an unmapped address. Permission and alignment faults are real errors
+static bool translation_fault(uint64_t esr){
+    if (ESR_EC(esr) != 0x24 && ESR_EC(esr) != 0x25) return false;
+    if (esr & ESR_FNV) return false;
+    return (esr & 0b111100) == DFSC_TRANSLATION;
+}
+
+//User stacks live in the address space, kernel ones in their slot. Anything else is a plain physical stack
+static bool demand_stack(process_t *proc){
+    return proc->page_table || proc->stack > KERNEL_STACKS_BASE;
+}
+
+static bool demand_map(process_t *proc, uintptr_t va){
+    void *page = kalloc_zeroed(0, PAGE_SIZE, ALIGN_4KB, true, false);
+    if (!page) return false;
+    if (proc->page_table)
+        mmu_map_user(proc->page_table, va, (uintptr_t)page, true);
+    else
+        register_proc_memory(va, (uintptr_t)page, true);
+    return true;
+}
+
+//The free list is sorted by address and never holds two touching extents, so a lookup stops at the first extent
+//that ends past va instead of walking the whole list
+static bool demand_extent_overlaps(process_t *proc, uintptr_t va, uint64_t size){
+    demand_extent *extent = proc->reserve_free;
+    while (extent && extent->va + extent->size <= va)
+        extent = extent->next;
+    return extent && extent->va < va + size;
+}
+
+bool demand_page_fault(process_t *proc, uint64_t esr, uintptr_t far){
+    if (!proc || !translation_fault(esr)) return false;
+    uintptr_t va = far & ~(uintptr_t)(PAGE_SIZE - 1);
+    bool stack = demand_stack(proc) && va >= proc->stack - proc->stack_size + PAGE_SIZE && va < proc->stack;
+    bool reserved = proc->page_table && va >= USER_RESERVE_BASE && va < proc->reserve_top && !demand_extent_overlaps(proc, va, PAGE_SIZE);
+    if (!stack && !reserved) return false;
+    return demand_map(proc, va);
+}
+
+//The lowest page of a stack's reservation is never mapped, running into it is an overflow rather than growth
+bool demand_stack_overflow(process_t *proc, uintptr_t far){
+    if (!proc || !demand_stack(proc)) return false;
+    uintptr_t guard = proc->stack - proc->stack_size;
+    return far >= guard && far < guard + PAGE_SIZE;
+}
+
+//Reserves the stack and commits its top page, the rest is mapped as the stack grows into it
+bool demand_stack_create(process_t *proc){
+    if (proc->page_table){
+        proc->stack = USER_STACK_TOP;
+        proc->stack_size = USER_STACK_RESERVE;
+    } else {
+        proc->stack = KERNEL_STACKS_BASE + ((uintptr_t)proc->slot + 1) * KERNEL_STACK_SLOT;
+        proc->stack_size = KERNEL_STACK_SLOT;
+    }
+    return demand_map(proc, proc->stack - PAGE_SIZE);
+}
+
+//User stacks go away with their address space, kernel ones hand their pages back here
+void demand_stack_release(process_t *proc){
+    if (proc->page_table || proc->stack <= KERNEL_STACKS_BASE) return;
+    for (uintptr_t va = proc->stack - proc->stack_size + PAGE_SIZE; va < proc->stack; va += PAGE_SIZE){
+        uintptr_t page = mmu_unmap_page(mmu_kernel_table(), va, 0);
+        if (page)
+            pfree((void*)page, PAGE_SIZE);
+    }
+}
+
+//Page aligned address space in the reservation area, first fit over freed ranges in address order before growing it.
+//Nothing is mapped until the process touches it
+uintptr_t demand_reserve(process_t *proc, uint64_t size){
+    if (!proc->page_table || !size) return 0;
+    size = (size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    for (demand_extent **link = &proc->reserve_free; *link; link = &(*link)->next){
+        demand_extent *extent = *link;
+        if (extent->size < size) continue;
+        uintptr_t va = extent->va;
+        extent->va += size;
+        extent->size -= size;
+        if (!extent->size){
+            *link = extent->next;
+            kfree(extent, sizeof(demand_extent));
+        }
+        return va;
+    }
+    if (USER_HEAP_BASE - proc->reserve_top < size) return 0;
+    uintptr_t va = proc->reserve_top;
+    proc->reserve_top += size;
+    return va;
+}
+
+//Frees the pages touched in [va, va + size) and makes the range available again, merged with the free extents
+//it touches. Fails without changing anything if the range isn't reserved or there is no memory to track it
+bool demand_release(process_t *proc, uintptr_t va, uint64_t size){
+    size = (size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    if (!proc->page_table || !size || (va & (PAGE_SIZE - 1)) || va < USER_RESERVE_BASE || va + size > proc->reserve_top) return false;
+
+    demand_extent *prev = NULL;
+    demand_extent **prev_link = NULL;
+    demand_extent **link = &proc->reserve_free;
+    while (*link && (*link)->va + (*link)->size <= va){
+        prev_link = link;
+        prev = *link;
+        link = &prev->next;
+    }
+    demand_extent *next = *link;
+    if (next && next->va < va + size) return false;
+
+    bool merge_prev = prev && prev->va + prev->size == va;
+    bool merge_next = next && va + size == next->va;
+    bool top = va + size == proc->reserve_top;
+    demand_extent *extent = NULL;
+    if (!merge_prev && !merge_next && !top){
+        extent = (demand_extent*)kalloc((void*)proc->heap, sizeof(demand_extent), ALIGN_16B, true, false);
+        if (!extent) return false;
+    }
+
+    for (uintptr_t page = va; page < va + size; page += PAGE_SIZE){
+        uintptr_t pa = mmu_unmap_page(proc->page_table, page, proc->asid);
+        if (pa)
+            pfree((void*)pa, PAGE_SIZE);
+    }
+
+    if (top){
+        //Nothing follows the range, so at most the last extent touches it and goes back to the top with it
+        proc->reserve_top = va;
+        if (merge_prev){
+            proc->reserve_top = prev->va;
+            *prev_link = NULL;
+            kfree(prev, sizeof(demand_extent));
+        }
+    } else if (merge_prev){
+        prev->size += size;
+        if (merge_next){
+            prev->size += next->size;
+            prev->next = next->next;
+            kfree(next, sizeof(demand_extent));
+        }
+    } else if (merge_next){
+        next->va = va;
+        next->size += size;
+    } else {
+        extent->va = va;
+        extent->size = size;
+        extent->next = next;
+        *link = extent;
+    }
+    return true;
+}
+
+//Reserves size bytes and maps them right away, with a copy of src if there is one. The pages are the process' own,
+//so nothing else the kernel keeps is on them. Returns the user address, 0 if it couldn't
+uintptr_t demand_copy_out(process_t *proc, const void *src, uint64_t size){
+    uintptr_t va = demand_reserve(proc, size);
+    if (!va) return 0;
+    for (uint64_t offset = 0; offset < size; offset += PAGE_SIZE){
+        if (!demand_map(proc, va + offset)){
+            demand_release(proc, va, size);
+            return 0;
+        }
+        uint64_t chunk = size - offset < PAGE_SIZE ? size - offset : PAGE_SIZE;
+        if (src)
+            memcpy((void*)mmu_user_translate(proc->page_table, va + offset), (const uint8_t*)src + offset, chunk);
+    }
+    return va;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct process;
+
+//Freed piece of a process' reservation area, linked through the process' heap
+typedef struct demand_extent {
+    uintptr_t va;
+    uint64_t size;
+    struct demand_extent *next;
+} demand_extent;
+
+//Maps a zeroed page where a process first touched its stack or a reservation. False for any other fault
+bool demand_page_fault(struct process *proc, uint64_t esr, uintptr_t far);
+bool demand_stack_overflow(struct process *proc, uintptr_t far);
+
+bool demand_stack_create(struct process *proc);
+void demand_stack_release(struct process *proc);
+
+uintptr_t demand_reserve(struct process *proc, uint64_t size);
+bool demand_release(struct process *proc, uintptr_t va, uint64_t size);
+uintptr_t demand_copy_out(struct process *proc, const void *src, uint64_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -36,6 +36,9 @@ typedef struct elf_program_header {
     uint64_t alignment;
 } elf_program_header;
 
+#define PT_LOAD 1
+#define ELF_MAX_SEGMENTS 8
+
 process_t* load_elf_file(const char *name, void* file){
     elf_header *header = (elf_header*)file;
 
@@ -48,10 +51,25 @@ process_t* load_elf_file(const char *name, void* file){
     kprintf("FILE %i for %x",header->type, header->instruction_set);
     kprintf("ENTRY %x - %i",header->program_entry_offset);
     kprintf("HEADER %x - %i * %i vs %i",header->program_header_offset, header->program_header_entry_size,header->program_header_num_entries,sizeof(elf_program_header));
-    elf_program_header* first_program_header = (elf_program_header*)((uint8_t *)file + header->program_header_offset);
-    kprintf("program takes up %x, begins at %x, and is %b, %b",first_program_header->p_filez, first_program_header->p_offset, first_program_header->segment_type, first_program_header->flags);
     kprintf("SECTION %x - %i * %i",header->section_header_offset, header->section_entry_size,header->section_num_entries);
-    kprintf("First instruction %x", *(uint64_t*)(file + header->program_entry_offset));
 
-    return create_process(name, (void*)(file + first_program_header->p_offset), first_program_header->p_filez, header->program_entry_offset);
+    process_segment segments[ELF_MAX_SEGMENTS];
+    uint32_t count = 0;
+    for (uint16_t i = 0; i < header->program_header_num_entries; i++){
+        elf_program_header *ph = (elf_program_header*)((uint8_t *)file + header->program_header_offset + (i * header->program_header_entry_size));
+        if (ph->segment_type != PT_LOAD) continue;
+        if (count == ELF_MAX_SEGMENTS){
+            kprintf("Too many loadable segments");
+            return 0;
+        }
+        kprintf("Segment takes up %x (%x in memory), begins at %x, loads at %x, and is %b",ph->p_filez, ph->p_memsz, ph->p_offset, ph->p_vaddr, ph->flags);
+        segments[count++] = (process_segment){
+            .va = ph->p_vaddr,
+            .content = (uint8_t *)file + ph->p_offset,
+            .size = ph->p_filez,
+            .mem_size = ph->p_memsz,
+        };
+    }
+
+    return create_process(name, segments, count, header->program_entry_offset);
 }
\ No newline at end of file
@@ -6,8 +6,14 @@ extern "C" {
 #include "types.h"
 #include "process/process.h"
 
-process_t* create_process(const char *name, void *content, uint64_t content_size, uintptr_t entry);
-void translate_enable_verbose();
+typedef struct {
+    uintptr_t va;
+    void *content;
+    uint64_t size;
+    uint64_t mem_size;
+} process_segment;
+
+process_t* create_process(const char *name, process_segment *segments, uint32_t count, uintptr_t entry);
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -7,6 +7,8 @@ extern "C" {
 #include "types.h"
 #include "keypress.h"
 #include "net/network_types.h"
+#include "exceptions/ktimer.h"
+#include "waitqueue.h"
 
 #define INPUT_BUFFER_CAPACITY 64
 #define PACKET_BUFFER_CAPACITY 128
@@ -14,32 +16,76 @@ extern "C" {
 typedef struct {
     volatile uint32_t write_index;
     volatile uint32_t read_index;
+    wait_queue readers;
     keypress entries[INPUT_BUFFER_CAPACITY];
 } input_buffer_t;
 
 typedef struct {
     volatile uint32_t write_index;
     volatile uint32_t read_index;
+    wait_queue readers;
     sizedptr entries[PACKET_BUFFER_CAPACITY];
 } packet_buffer_t;
 
 #define MAX_PROC_NAME_LENGTH 256
 
-typedef struct {
+//Whole-page allocation handed out by process_alloc, linked from the process so it's freed when the process stops
+typedef struct heap_run {
+    uintptr_t addr;
+    struct heap_run *next;
+} heap_run;
+
+typedef struct process {
     //We use the addresses of these variables to save and restore process state
     uint64_t regs[31]; // x0–x30
     uintptr_t sp;
     uintptr_t pc;
     uint64_t spsr; 
+    //FP/SIMD state, only saved and restored when the process actually uses it. fpu_save_state relies on this layout
+    uint64_t fpcr;
+    uint64_t fpsr;
+    __uint128_t vregs[32];
     //Not used in process saving
     uint16_t id;
     uintptr_t stack;
     uint64_t stack_size;
     uintptr_t heap;
+    heap_run *heap_runs;
+    //Network ports bound to this process' pid
+    uint16_t bound_ports;
+    //User processes only, kernel processes run on the kernel tables
+    uint64_t *page_table;
+    uint16_t asid;
+    //End of the address space handed out by demand_reserve and the ranges freed below it
+    uintptr_t reserve_top;
+    struct demand_extent *reserve_free;
+    //Index in the process table, which picks a kernel process' stack slot. Kept across reuse
+    uint32_t slot;
     bool focused;
     enum process_state { STOPPED, READY, RUNNING, BLOCKED } state;
-    input_buffer_t input_buffer;
-    packet_buffer_t packet_buffer;
+    //Scheduling. priority is the base level, dyn_priority the level it's currently queued at
+    uint8_t priority;
+    uint8_t dyn_priority;
+    bool queued;
+    uint8_t cpu;
+    //Core whose FP registers last held this process' state
+    uint8_t fpu_cpu;
+    struct process *rq_next;
+    struct process *rq_prev;
+    struct process *hash_next;
+    //Used both by sleep and by wait queue timeouts, a process is never doing both at once
+    ktimer sleep_timer;
+    wait_queue *waiting_on;
+    struct process *wait_next;
+    bool wait_expired;
+    //Submission/completion rings, allocated in the process heap by ring_setup
+    struct syscall_ring *ring;
+    //Sources this process is blocked on in wait_events
+    uint32_t event_mask;
+    wait_queue event_waiters;
+    //Allocated on first use, see get_input_buffer and get_packet_buffer
+    input_buffer_t *input_buffer;
+    packet_buffer_t *packet_buffer;
     char name[MAX_PROC_NAME_LENGTH];
 } process_t;
 
@@ -0,0 +1,23 @@
+#include "process_events.h"
+
+uint32_t process_ready_events(process_t *proc, uint32_t mask){
+    uint32_t ready = 0;
+    input_buffer_t *input = proc->input_buffer;
+    if ((mask & EVENT_INPUT) && input && input->read_index != input->write_index)
+        ready |= EVENT_INPUT;
+    packet_buffer_t *packets = proc->packet_buffer;
+    if ((mask & EVENT_PACKET) && packets && packets->read_index != packets->write_index)
+        ready |= EVENT_PACKET;
+    return ready;
+}
+
+//Producers call this after filling one of the process' buffers. It wakes whoever is reading that buffer,
+//and the process itself if it's in wait_events for this source
+void process_signal_event(process_t *proc, uint32_t event){
+    if (event == EVENT_INPUT && proc->input_buffer)
+        wait_queue_wake_all(&proc->input_buffer->readers);
+    if (event == EVENT_PACKET && proc->packet_buffer)
+        wait_queue_wake_all(&proc->packet_buffer->readers);
+    if (proc->event_mask & event)
+        wait_queue_wake_all(&proc->event_waiters);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "types.h"
+#include "events.h"
+#include "process.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t process_ready_events(process_t *proc, uint32_t mask);
+void process_signal_event(process_t *proc, uint32_t event);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,41 +2,333 @@
 #include "console/kio.h"
 #include "memory/kalloc.h"
 #include "memory/page_allocator.h"
+#include "memory/mmu.h"
+#include "demand_paging.h"
 #include "exceptions/irq.h"
 #include "console/serial/uart.h"
 #include "input/input_dispatch.h"
 #include "exceptions/exception_handler.h"
 #include "exceptions/timer.h"
+#include "exceptions/ktimer.h"
+#include "hw/smp.h"
+#include "std/memfunctions.h"
+#include "networking/network.h"
 
 extern void save_context(process_t* proc);
 extern void save_pc_interrupt(process_t* proc);
 extern void restore_context(process_t* proc);
+extern void fpu_save_state(process_t* proc);
+extern void fpu_restore_state(process_t* proc);
+
+#define CPACR_FPEN (3 << 20)
+#define FPU_NO_CPU 0xFF
+
+//Process structs are allocated one by one from a kernel page chain and never move.
+//The table is split in page sized chunks of pointers so it can grow without copying, and pids are looked up through a hash.
+#define PROC_CHUNK_ENTRIES (PAGE_SIZE / sizeof(process_t*))
+#define PROC_CHUNKS ((UINT16_MAX + 1) / PROC_CHUNK_ENTRIES)
+#define PID_HASH_BUCKETS 512
+
+static void *proc_page;
+static process_t **proc_chunks[PROC_CHUNKS];
+static uint32_t proc_table_size;
+static process_t *pid_hash[PID_HASH_BUCKETS];
+//Stopped processes waiting to be reused, linked through rq_next
+static process_t *stopped_procs;
 
-#define MAX_PROCS 16
-//TODO: use queues, eliminate the max procs limitation
-process_t processes[MAX_PROCS];
-uint16_t current_proc = 0;
 uint16_t proc_count = 0;
 uint16_t next_proc_index = 1;
 
-typedef struct sleep_tracker {
-    uint16_t pid;
-    uint64_t timestamp;
-    uint64_t sleep_time;
-    bool valid;
-} sleep_tracker;
+typedef struct run_queue {
+    process_t *head;
+    process_t *tail;
+} run_queue;
+
+typedef struct cpu_data {
+    //Must stay first, exception entry reads it through tpidr_el1 before any other register can be touched
+    process_t *current;
+    //Set while this core runs kernel code on behalf of an exception. Read from syscall_as.S at offset 8
+    volatile uint8_t in_handler;
+    //Read by the exception entry stubs at offset 16
+    uint64_t ksp;
+    //Process whose FP/SIMD state is in this core's registers. fpu_dirty means they may be newer than its saved copy
+    process_t *fpu_owner;
+    bool fpu_dirty;
+    bool fpu_enabled;
+    //Until the scheduler starts on this core FP/SIMD stays enabled for the boot code
+    bool fpu_lazy;
+    uint16_t id;
+    bool online;
+    //One FIFO per priority level, with bit n of ready_bitmap set while run_queues[n] is not empty
+    run_queue run_queues[PRIORITY_LEVELS];
+    uint32_t ready_bitmap;
+    uint32_t nr_ready;
+    bool tick_active;
+    //Tables in TTBR0, and the last process table that ran with the shared ASID 0 on this core
+    uint64_t *loaded_table;
+    uint64_t *shared_asid_table;
+    process_t idle;
+} cpu_data;
+
+cpu_data cpus[MAX_CORES];
+
+static volatile bool scheduler_running;
+
+scheduler_stats sched_stats;
+
+__attribute__((always_inline))
+static inline cpu_data* this_cpu(){
+    cpu_data *cpu;
+    asm volatile ("mrs %0, tpidr_el1" : "=r"(cpu));
+    return cpu;
+}
+
+//FP/SIMD use traps while FPEN is clear, so the registers are only saved and restored for processes that touch them
+static void fpu_set_enabled(cpu_data *cpu, bool enabled){
+    uint64_t cpacr;
+    asm volatile ("mrs %0, cpacr_el1" : "=r"(cpacr));
+    cpacr = enabled ? cpacr | CPACR_FPEN : cpacr & ~CPACR_FPEN;
+    asm volatile ("msr cpacr_el1, %0\nisb" :: "r"(cpacr));
+    cpu->fpu_enabled = enabled;
+}
+
+//The state is written back when its owner is switched out, so the process can resume on any core.
+//The owner keeps its claim on the registers, and gets them back without a reload if nothing else used them meanwhile
+static void fpu_switch_out(cpu_data *cpu, process_t *prev){
+    if (cpu->fpu_owner != prev || !cpu->fpu_dirty) return;
+    if (prev->state != STOPPED){
+        fpu_set_enabled(cpu, true);
+        fpu_save_state(prev);
+        fpu_set_enabled(cpu, false);
+    } else cpu->fpu_owner = NULL;
+    cpu->fpu_dirty = false;
+}
+
+static void fpu_switch_in(cpu_data *cpu, process_t *next){
+    if (!cpu->fpu_lazy) return;
+    bool live = cpu->fpu_owner == next && next->fpu_cpu == cpu->id;
+    if (live != cpu->fpu_enabled)
+        fpu_set_enabled(cpu, live);
+    if (live)
+        cpu->fpu_dirty = true;
+}
+
+void fpu_kernel_enter(){
+    cpu_data *cpu = this_cpu();
+    cpu->in_handler = true;
+    //Kernel code using FP/SIMD must trap instead of clobbering the owner's registers
+    if (cpu->fpu_lazy && cpu->fpu_enabled)
+        fpu_set_enabled(cpu, false);
+}
+
+//For paths that return to the same process without going through process_restore
+void fpu_kernel_exit(){
+    cpu_data *cpu = this_cpu();
+    fpu_switch_in(cpu, cpu->current);
+    cpu->in_handler = false;
+}
 
-sleep_tracker sleeping[MAX_PROCS];
-uint16_t sleep_count;
+//FP/SIMD trap from a process. It resumes at the trapping instruction with its own registers loaded
+void fpu_trap(){
+    cpu_data *cpu = this_cpu();
+    process_t *proc = cpu->current;
+    if (cpu->fpu_owner == proc && proc->fpu_cpu == cpu->id) return;
+    fpu_set_enabled(cpu, true);
+    if (cpu->fpu_owner && cpu->fpu_dirty)
+        fpu_save_state(cpu->fpu_owner);
+    fpu_restore_state(proc);
+    fpu_set_enabled(cpu, false);
+    cpu->fpu_owner = proc;
+    cpu->fpu_dirty = false;
+    proc->fpu_cpu = cpu->id;
+}
 
-uint64_t ksp;
+//FP/SIMD trap from kernel code inside an exception handler. The owner's state is saved and the registers are
+//left to the kernel until the handler returns
+void fpu_kernel_trap(){
+    cpu_data *cpu = this_cpu();
+    fpu_set_enabled(cpu, true);
+    if (cpu->fpu_owner && cpu->fpu_dirty)
+        fpu_save_state(cpu->fpu_owner);
+    cpu->fpu_owner = NULL;
+    cpu->fpu_dirty = false;
+}
 
 void save_context_registers(){
-    save_context(&processes[current_proc]);
+    save_context(this_cpu()->current);
 }
 
 void save_return_address_interrupt(){
-    save_pc_interrupt(&processes[current_proc]);
+    save_pc_interrupt(this_cpu()->current);
+}
+
+uint64_t get_ksp(){
+    return this_cpu()->ksp;
+}
+
+//Zeroes pages for the page allocator's pool while there's nothing else to run
+void cpu_idle(){
+    while (1){
+        if (!zero_pool_refill())
+            asm volatile ("wfi");
+    }
+}
+
+void init_cpu_scheduler(uint16_t id, uint64_t stack_top){
+    cpu_data *cpu = &cpus[id];
+    cpu->id = id;
+    cpu->ksp = stack_top;
+    asm volatile ("msr tpidr_el1, %0" :: "r"(cpu));
+
+    process_t *idle = &cpu->idle;
+    idle->stack_size = 0x1000;
+    idle->stack = (uintptr_t)palloc(idle->stack_size, true, false, true) + idle->stack_size;
+    idle->sp = idle->stack;
+    idle->pc = (uintptr_t)cpu_idle;
+    idle->spsr = 0x205;
+    idle->state = READY;
+    idle->fpu_cpu = FPU_NO_CPU;
+    name_process(idle, "idle");
+    if (!cpu->current)
+        cpu->current = idle;
+    cpu->online = true;
+}
+
+bool scheduler_is_running(){
+    return scheduler_running;
+}
+
+bool get_cpu_online(uint16_t id){
+    return ((volatile cpu_data*)&cpus[id])->online;
+}
+
+uint8_t base_priority(process_t *proc){
+    if (proc->focused)
+        return proc->priority > PRIORITY_FOCUS_BOOST ? proc->priority - PRIORITY_FOCUS_BOOST : 0;
+    return proc->priority;
+}
+
+void rq_push(process_t *proc){
+    cpu_data *cpu = &cpus[proc->cpu];
+    run_queue *rq = &cpu->run_queues[proc->dyn_priority];
+    proc->rq_next = NULL;
+    proc->rq_prev = rq->tail;
+    if (rq->tail)
+        rq->tail->rq_next = proc;
+    else
+        rq->head = proc;
+    rq->tail = proc;
+    proc->queued = true;
+    cpu->nr_ready++;
+    cpu->ready_bitmap |= (1 << proc->dyn_priority);
+}
+
+void rq_remove(process_t *proc){
+    cpu_data *cpu = &cpus[proc->cpu];
+    run_queue *rq = &cpu->run_queues[proc->dyn_priority];
+    if (proc->rq_prev)
+        proc->rq_prev->rq_next = proc->rq_next;
+    else
+        rq->head = proc->rq_next;
+    if (proc->rq_next)
+        proc->rq_next->rq_prev = proc->rq_prev;
+    else
+        rq->tail = proc->rq_prev;
+    proc->rq_next = NULL;
+    proc->rq_prev = NULL;
+    proc->queued = false;
+    cpu->nr_ready--;
+    if (!rq->head)
+        cpu->ready_bitmap &= ~(1 << proc->dyn_priority);
+}
+
+//Takes the highest priority process queued on the busiest other core
+process_t* rq_steal(cpu_data *cpu){
+    cpu_data *victim = NULL;
+    for (uint16_t i = 0; i < MAX_CORES; i++){
+        if (&cpus[i] == cpu || !cpus[i].online || !cpus[i].ready_bitmap) continue;
+        if (!victim || cpus[i].nr_ready > victim->nr_ready)
+            victim = &cpus[i];
+    }
+    if (!victim) return NULL;
+    process_t *proc = victim->run_queues[__builtin_ctz(victim->ready_bitmap)].head;
+    rq_remove(proc);
+    proc->cpu = cpu->id;
+    return proc;
+}
+
+process_t* rq_pick_next(cpu_data *cpu){
+    if (!cpu->ready_bitmap) return rq_steal(cpu);
+    process_t *proc = cpu->run_queues[__builtin_ctz(cpu->ready_bitmap)].head;
+    rq_remove(proc);
+    return proc;
+}
+
+uint8_t least_loaded_cpu(){
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < MAX_CORES; i++)
+        if (cpus[i].online && cpus[i].nr_ready < cpus[best].nr_ready)
+            best = i;
+    return best;
+}
+
+//Only ticks while something is waiting behind the current process
+void update_tick(cpu_data *cpu){
+    if (cpu->nr_ready){
+        timer_start();
+        cpu->tick_active = true;
+    } else if (cpu->tick_active){
+        timer_stop();
+        cpu->tick_active = false;
+    }
+}
+
+//Makes sure a core notices new work, either by restarting its own tick or by interrupting it
+void kick_cpu(cpu_data *cpu){
+    if (cpu == this_cpu()){
+        if (!cpu->tick_active) update_tick(cpu);
+    } else if (cpu->current == &cpu->idle || !cpu->tick_active)
+        gic_send_sgi(cpu->id, IPI_RESCHEDULE);
+}
+
+cpu_data* find_idle_cpu(){
+    for (uint16_t i = 0; i < MAX_CORES; i++)
+        if (cpus[i].online && cpus[i].current == &cpus[i].idle && !cpus[i].nr_ready)
+            return &cpus[i];
+    return NULL;
+}
+
+void enqueue_process(process_t *proc){
+    proc->state = READY;
+    if (proc->queued) return;
+    proc->dyn_priority = base_priority(proc);
+    cpu_data *target = &cpus[proc->cpu];
+    if (target->current != &target->idle || target->nr_ready){
+        cpu_data *idle = find_idle_cpu();
+        if (idle) proc->cpu = idle->id;
+    }
+    rq_push(proc);
+    if (scheduler_running)
+        kick_cpu(&cpus[proc->cpu]);
+}
+
+void set_process_priority(process_t *proc, uint8_t priority){
+    proc->priority = priority < PRIORITY_LEVELS ? priority : PRIORITY_LOWEST;
+    reprioritize_process(proc);
+}
+
+void reprioritize_process(process_t *proc){
+    if (!proc->queued){
+        proc->dyn_priority = base_priority(proc);
+        return;
+    }
+    rq_remove(proc);
+    proc->dyn_priority = base_priority(proc);
+    rq_push(proc);
+}
+
+scheduler_stats get_scheduler_stats(){
+    return sched_stats;
 }
 
 //TODO: Processes can currently exit and just crash the whole system with an EL1 Sync exception trying to read from 0x0. Better than continuing execution past bounds but still not great
@@ -44,115 +336,330 @@ void switch_proc(ProcSwitchReason reason) {
     // kprintf("Stopping execution of process %i at %x",current_proc, processes[current_proc].spsr);
     if (proc_count == 0)
         panic("No processes active");
-    int next_proc = (current_proc + 1) % MAX_PROCS;
-    while (processes[next_proc].state != READY) {
-        next_proc = (next_proc + 1) % MAX_PROCS;
+    uint64_t start = timer_now();
+    cpu_data *cpu = this_cpu();
+    //Let cores waiting on the kernel lock in before picking, so kernel processes can't keep it forever
+    kernel_lock_yield();
+    process_t *prev = cpu->current;
+    fpu_switch_out(cpu, prev);
+    if (prev != &cpu->idle && prev->state == READY && !prev->queued){
+        if (reason == INTERRUPT)
+            prev->dyn_priority = prev->dyn_priority < PRIORITY_LOWEST ? prev->dyn_priority + 1 : PRIORITY_LOWEST;
+        else
+            prev->dyn_priority = base_priority(prev);
+        rq_push(prev);
     }
 
-    current_proc = next_proc;
-    timer_reset();
+    uint64_t picked = timer_now();
+    process_t *next = rq_pick_next(cpu);
+    sched_stats.pick_ticks += timer_now() - picked;
+    if (!next)
+        next = &cpu->idle;
+
+    cpu->current = next;
+    sched_stats.switches++;
+    sched_stats.switch_ticks += timer_now() - start;
+    update_tick(cpu);
     process_restore();
 }
 
 void save_syscall_return(uint64_t value){
-    processes[current_proc].regs[14] = value;
+    this_cpu()->current->regs[14] = value;
+}
+
+//Kernel processes and the idle loop use the kernel tables, whose mappings every address space shares.
+//ASIDs keep each process' TLB entries apart, so only processes sharing ASID 0 need a flush
+static void switch_address_space(cpu_data *cpu, process_t *next){
+    uint64_t *table = next->page_table ? next->page_table : mmu_kernel_table();
+    if (table == cpu->loaded_table) return;
+    bool flush = false;
+    if (next->page_table && next->asid == 0){
+        flush = cpu->shared_asid_table != table;
+        cpu->shared_asid_table = table;
+    }
+    mmu_load_address_space(table, next->page_table ? next->asid : 0, flush);
+    cpu->loaded_table = table;
 }
 
 void process_restore(){
-    restore_context(&processes[current_proc]);
+    cpu_data *cpu = this_cpu();
+    if (cpu->current == &cpu->idle && cpu->nr_ready){
+        switch_proc(YIELD);
+        return;
+    }
+    if (cpu->nr_ready && !cpu->tick_active)
+        update_tick(cpu);
+    fpu_switch_in(cpu, cpu->current);
+    switch_address_space(cpu, cpu->current);
+    cpu->in_handler = false;
+    //EL0 processes and the idle loop never touch kernel state, so other cores can take the lock while they run
+    if (cpu->current == &cpu->idle || (cpu->current->spsr & 0b1111) == 0)
+        kernel_unlock();
+    restore_context(cpu->current);
 }
 
 void start_scheduler(){
     disable_interrupt();
     timer_init(1);
+    cpu_data *cpu = this_cpu();
+    cpu->tick_active = true;
+    cpu->fpu_lazy = true;
+    fpu_set_enabled(cpu, false);
+    kernel_lock();
+    if (!scheduler_running){
+        scheduler_running = true;
+        asm volatile ("dsb ish\nsev");
+    }
     switch_proc(YIELD);
 }
 
 uintptr_t get_current_heap(){
-    return processes[current_proc].heap;
+    return this_cpu()->current->heap;
 }
 
 bool get_current_privilege(){
-    return (processes[current_proc].spsr & 0b1111) != 0;
+    return (this_cpu()->current->spsr & 0b1111) != 0;
 }
 
 process_t* get_current_proc(){
-    return &processes[current_proc];
+    return this_cpu()->current;
 }
 
 process_t* get_proc_by_pid(uint16_t pid){
-    for (int i = 0; i < MAX_PROCS; i++)
-        if (processes[i].id == pid)
-            return &processes[i];
+    for (process_t *proc = pid_hash[pid % PID_HASH_BUCKETS]; proc; proc = proc->hash_next)
+        if (proc->id == pid)
+            return proc;
     return NULL;
 }
 
+static void pid_hash_remove(process_t *proc){
+    process_t **slot = &pid_hash[proc->id % PID_HASH_BUCKETS];
+    while (*slot && *slot != proc)
+        slot = &(*slot)->hash_next;
+    if (*slot)
+        *slot = proc->hash_next;
+    proc->hash_next = NULL;
+}
+
+static void assign_pid(process_t *proc){
+    if (proc->id)
+        pid_hash_remove(proc);
+    //Pids wrap around, skip 0 and any still in use
+    do {
+        proc->id = next_proc_index++;
+    } while (proc->id == 0 || get_proc_by_pid(proc->id));
+    process_t **bucket = &pid_hash[proc->id % PID_HASH_BUCKETS];
+    proc->hash_next = *bucket;
+    *bucket = proc;
+}
+
+static process_t* alloc_process(){
+    if (stopped_procs){
+        process_t *proc = stopped_procs;
+        stopped_procs = proc->rq_next;
+        proc->rq_next = NULL;
+        return proc;
+    }
+    if (proc_table_size > UINT16_MAX) return NULL;
+    if (!proc_page)
+        proc_page = palloc(PAGE_SIZE, true, false, false);
+    uint32_t chunk = proc_table_size / PROC_CHUNK_ENTRIES;
+    if (!proc_chunks[chunk]){
+        proc_chunks[chunk] = (process_t**)palloc(PAGE_SIZE, true, false, true);
+        if (!proc_chunks[chunk]) return NULL;
+        memset(proc_chunks[chunk], 0, PAGE_SIZE);
+    }
+    process_t *proc = (process_t*)kalloc(proc_page, sizeof(process_t), ALIGN_64B, true, false);
+    if (!proc) return NULL;
+    proc_chunks[chunk][proc_table_size % PROC_CHUNK_ENTRIES] = proc;
+    proc->slot = proc_table_size;
+    proc_table_size++;
+    return proc;
+}
+
+input_buffer_t* get_input_buffer(process_t *proc){
+    if (!proc->input_buffer)
+        proc->input_buffer = (input_buffer_t*)kalloc(proc_page, sizeof(input_buffer_t), ALIGN_16B, true, false);
+    return proc->input_buffer;
+}
+
+packet_buffer_t* get_packet_buffer(process_t *proc){
+    if (!proc->packet_buffer)
+        proc->packet_buffer = (packet_buffer_t*)kalloc(proc_page, sizeof(packet_buffer_t), ALIGN_16B, true, false);
+    return proc->packet_buffer;
+}
+
 uint16_t get_current_proc_pid(){
-    return processes[current_proc].id;
+    return this_cpu()->current->id;
+}
+
+static bool is_kernel_stack(uintptr_t top){
+    for (int i = 0; i < MAX_CORES; i++)
+        if (cpus[i].ksp == top)
+            return true;
+    return false;
+}
+
+//Gives back everything a process holds outside its process_t. Safe to call again, whatever was released is cleared.
+//The caller must not be running on the process' stack or with its address space loaded on another core
+static void release_process(process_t *proc){
+    cpu_data *cpu = this_cpu();
+    //A user process' stack, code and reservations are owned pages of its address space
+    if (proc->page_table){
+        if (cpu->loaded_table == proc->page_table){
+            mmu_load_address_space(mmu_kernel_table(), 0, false);
+            cpu->loaded_table = mmu_kernel_table();
+        }
+        for (int i = 0; i < MAX_CORES; i++)
+            if (cpus[i].shared_asid_table == proc->page_table)
+                cpus[i].shared_asid_table = NULL;
+        mmu_free_address_space(proc->page_table);
+        mmu_asid_free(proc->asid);
+        //Mapped but not owned, so the ring page outlives the tables and is freed here
+        if (proc->ring)
+            pfree(proc->ring, PAGE_SIZE);
+    } else if (proc->stack > KERNEL_STACKS_BASE)
+        demand_stack_release(proc);
+    else if (proc->stack && !is_kernel_stack(proc->stack))
+        pfree((void*)proc->stack-proc->stack_size,proc->stack_size);
+    proc->page_table = NULL;
+    proc->asid = 0;
+    proc->reserve_top = 0;
+    proc->reserve_free = NULL;
+    proc->stack = 0;
+    proc->stack_size = 0;
+
+    if (proc->bound_ports)
+        network_unbind_process(proc->id);
+    proc->bound_ports = 0;
+
+    //A kernel process' ring and a user one's reservation list live in the heap, so they go with it
+    for (heap_run *run = proc->heap_runs; run; run = run->next)
+        kfree((void*)run->addr, 0);
+    proc->heap_runs = NULL;
+    proc->ring = NULL;
+    if (proc->heap)
+        kalloc_release((void*)proc->heap);
+    proc->heap = 0;
+
+    if (proc->input_buffer){
+        kfree(proc->input_buffer, sizeof(input_buffer_t));
+        proc->input_buffer = NULL;
+    }
+    //Entries between the read and write indexes are the only ones still owned, read_packet frees the rest
+    if (proc->packet_buffer){
+        packet_buffer_t *buf = proc->packet_buffer;
+        for (uint32_t k = buf->read_index; k != buf->write_index; k = (k + 1) % PACKET_BUFFER_CAPACITY)
+            free_sized(buf->entries[k]);
+        kfree(buf, sizeof(packet_buffer_t));
+        proc->packet_buffer = NULL;
+    }
+}
+
+//Whole-page allocations are linked to the process, everything else lives in its heap chain and goes with it
+void* process_alloc(process_t *proc, uint64_t size, uint16_t alignment, bool zero){
+    void *ptr = zero ? kalloc((void*)proc->heap, size, alignment, true, false) : kalloc_uninit((void*)proc->heap, size, alignment, true, false);
+    if (!ptr || (size <= KALLOC_MAX_CLASS && alignment < PAGE_SIZE)) return ptr;
+    heap_run *run = (heap_run*)kalloc((void*)proc->heap, sizeof(heap_run), ALIGN_16B, true, false);
+    if (!run){
+        kfree(ptr, size);
+        return NULL;
+    }
+    run->addr = (uintptr_t)ptr;
+    run->next = proc->heap_runs;
+    proc->heap_runs = run;
+    return ptr;
+}
+
+//Page aligned pointers the process doesn't own are ignored rather than handed to the page allocator
+void process_free(process_t *proc, void *ptr, uint64_t size){
+    if ((uintptr_t)ptr & (PAGE_SIZE - 1)){
+        kfree(ptr, size);
+        return;
+    }
+    for (heap_run **link = &proc->heap_runs; *link; link = &(*link)->next){
+        heap_run *run = *link;
+        if (run->addr != (uintptr_t)ptr) continue;
+        *link = run->next;
+        kfree(run, sizeof(heap_run));
+        kfree(ptr, size);
+        return;
+    }
+}
+
+//libshared's malloc and free run in user space. The kernel links these instead, which skip the syscall
+//and use the current process' heap directly
+uintptr_t malloc(size_t size){
+    return (uintptr_t)process_alloc(get_current_proc(), size, ALIGN_16B, true);
+}
+
+void free(void *ptr, size_t size){
+    process_free(get_current_proc(), ptr, size);
 }
 
 void reset_process(process_t *proc){
     proc->sp = 0;
-    pfree((void*)proc->stack-proc->stack_size,proc->stack_size);
+    proc->queued = false;
+    proc->rq_next = NULL;
+    proc->rq_prev = NULL;
+    ktimer_cancel(&proc->sleep_timer);
+    wait_queue_remove(proc);
+    proc->wait_expired = false;
+    proc->event_mask = 0;
+    for (int i = 0; i < MAX_CORES; i++)
+        if (cpus[i].fpu_owner == proc)
+            cpus[i].fpu_owner = NULL;
+    proc->fpu_cpu = FPU_NO_CPU;
+    proc->fpcr = 0;
+    proc->fpsr = 0;
+    for (int k = 0; k < 32; k++)
+        proc->vregs[k] = 0;
+    release_process(proc);
     proc->pc = 0;
     proc->spsr = 0;
+    proc->focused = false;
     for (int j = 0; j < 31; j++)
         proc->regs[j] = 0;
     for (int k = 0; k < MAX_PROC_NAME_LENGTH; k++)
         proc->name[k] = 0;
-    proc->input_buffer.read_index = 0;
-    proc->input_buffer.write_index = 0;
-    for (int k = 0; k < INPUT_BUFFER_CAPACITY; k++){
-        proc->input_buffer.entries[k] = (keypress){0};
-    }
-    proc->packet_buffer.read_index = 0;
-    proc->packet_buffer.write_index = 0;
-    for (int k = 0; k < PACKET_BUFFER_CAPACITY; k++){
-        sizedptr p = proc->packet_buffer.entries[k];
-        if (p.ptr)
-            free_sized(p);
-        proc->packet_buffer.entries[k] = (sizedptr){0};
-    }
 }
 
 void init_main_process(){
-    process_t* proc = &processes[0];
+    process_t* proc = alloc_process();
     reset_process(proc);
-    proc->id = next_proc_index++;
+    assign_pid(proc);
     proc->state = BLOCKED;
     proc->heap = (uintptr_t)palloc(0x1000, true, false, false);
     proc->stack_size = 0x1000;
-    proc->stack = (uintptr_t)palloc(proc->stack_size,true,false,true);
-    ksp = proc->stack + proc->stack_size;
-    proc->sp = ksp;
+    proc->stack = (uintptr_t)palloc(proc->stack_size,true,false,true) + proc->stack_size;
+    proc->sp = proc->stack;
     name_process(proc, "kernel");
     proc_count++;
+    cpus[0].current = proc;
+    init_cpu_scheduler(0, proc->sp);
 }
 
 process_t* init_process(){
-    process_t* proc;
-    if (next_proc_index >= MAX_PROCS){
-        for (uint16_t i = 0; i < MAX_PROCS; i++){
-            if (processes[i].state == STOPPED){
-                proc = &processes[i];
-                reset_process(proc);
-                proc->state = READY;
-                proc->id = next_proc_index++;
-                proc_count++;
-                return proc;
-            }
-        }
+    process_t* proc = alloc_process();
+    if (!proc)
         panic("Out of process memory");
-    }
-
-    proc = &processes[next_proc_index];
     reset_process(proc);
-    proc->id = next_proc_index++;
-    proc->state = READY;
+    assign_pid(proc);
+    proc->state = BLOCKED;
+    proc->priority = PRIORITY_DEFAULT;
+    proc->cpu = least_loaded_cpu();
     proc_count++;
     return proc;
 }
 
+void discard_process(process_t *proc){
+    release_process(proc);
+    proc->state = STOPPED;
+    proc->rq_next = stopped_procs;
+    stopped_procs = proc;
+    proc_count--;
+}
+
 void name_process(process_t *proc, const char *name){
     uint32_t len = 0;
     while (len < MAX_PROC_NAME_LENGTH && name[len] != '\0') len++;
@@ -160,64 +667,66 @@ void name_process(process_t *proc, const char *name){
         proc->name[i] = name[i];
 }
 
+//A blocked process is taken off whatever it waits on, a sleep or wait timeout included
 void stop_process(uint16_t pid){
     disable_interrupt();
     process_t *proc = get_proc_by_pid(pid);
-    if (proc->state != READY) return;
-    proc->state = STOPPED;
+    if (!proc || (proc->state != READY && proc->state != BLOCKED)){
+        enable_interrupt();
+        return;
+    }
+    ktimer_cancel(&proc->sleep_timer);
+    wait_queue_remove(proc);
+    if (proc->queued)
+        rq_remove(proc);
     if (proc->focused)
         sys_unset_focus();
-    //TODO: we don't wipe the process' data. If we do, we corrupt our sp, since we're still in the process' sp.
-    proc_count--;
+    discard_process(proc);
     // kprintf("Stopped %i process %i",pid,proc_count);
     switch_proc(HALT);
 }
 
+static void __attribute__((used, noreturn)) stop_on_kernel_stack(){
+    stop_process(this_cpu()->current->id);
+    //Only reached if the process wasn't running, which leaves nothing to return to either
+    disable_interrupt();
+    switch_proc(HALT);
+    __builtin_unreachable();
+}
+
+//The process' own stack is among the things being freed, so the rest runs on the core's kernel stack.
+//Nothing on the abandoned frames is needed again, the core switches away for good
 void stop_current_process(){
     disable_interrupt();
-    stop_process(processes[current_proc].id);
+    uint64_t ksp = this_cpu()->ksp;
+    if (ksp)
+        asm volatile ("mov sp, %0\nb stop_on_kernel_stack" :: "r"(ksp) : "memory");
+    stop_on_kernel_stack();
 }
 
 uint16_t process_count(){
     return proc_count;
 }
 
-process_t *get_all_processes(){
-    return processes;
+uint32_t process_table_size(){
+    return proc_table_size;
 }
 
-void sleep_process(uint64_t msec){
-    if (sleep_count < MAX_PROCS){
-        processes[current_proc].state = BLOCKED;
-        sleeping[sleep_count++] = (sleep_tracker){
-            .pid = processes[current_proc].id,
-            .timestamp = timer_now_msec(),
-            .sleep_time = msec, 
-            .valid = true
-        };
-    }
-    if (virtual_timer_remaining_msec() > msec || virtual_timer_remaining_msec() == 0){
-        virtual_timer_reset(msec);
-        virtual_timer_enable();
-    }
-    switch_proc(YIELD);
+process_t *get_process_at(uint32_t index){
+    if (index >= proc_table_size) return NULL;
+    return proc_chunks[index / PROC_CHUNK_ENTRIES][index % PROC_CHUNK_ENTRIES];
 }
 
-void wake_processes(){
-    uint16_t removed = 0;
-    uint64_t new_wake_time = 0;
-    for (uint16_t i = 0; i < sleep_count; i++){
-        uint64_t wake_time = sleeping[i].timestamp + sleeping[i].sleep_time;
-        if (wake_time <= timer_now_msec()){
-            process_t *proc = get_proc_by_pid(sleeping[i].pid);
-            proc->state = READY;
-            sleeping[i].valid = false;
-            removed++;
-        } else if (new_wake_time == 0 || wake_time < new_wake_time){
-            new_wake_time = wake_time;
-        }
-    }
-    sleep_count -= removed;
-    virtual_timer_reset(timer_now_msec() - new_wake_time);
-    virtual_timer_enable();
+static void wake_sleeper(void *ctx){
+    enqueue_process((process_t*)ctx);
+}
+
+void sleep_process(uint64_t msec){
+    process_t *proc = this_cpu()->current;
+    ktimer_init(&proc->sleep_timer, wake_sleeper, proc);
+    if (ktimer_arm(&proc->sleep_timer, msec))
+        proc->state = BLOCKED;
+    else
+        kprintf("[scheduler error] No memory left for the sleep timer of process %i, it only yields", proc->id);
+    switch_proc(YIELD);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "types.h"
 #include "process/process.h"
+#include "hw/smp.h"
 
 typedef enum {
     INTERRUPT,
@@ -9,16 +10,36 @@ typedef enum {
     HALT,
 } ProcSwitchReason;
 
-#define MAX_PROCS 16
+//Lower levels are picked first. Processes that exhaust their time slice sink one level, processes that yield return to their base level
+#define PRIORITY_LEVELS 8
+#define PRIORITY_DRIVER 1
+#define PRIORITY_KERNEL 2
+#define PRIORITY_DEFAULT 4
+#define PRIORITY_LOWEST (PRIORITY_LEVELS - 1)
+#define PRIORITY_FOCUS_BOOST 2
+
+typedef struct {
+    uint64_t switches;
+    uint64_t pick_ticks;
+    uint64_t switch_ticks;
+} scheduler_stats;
 
 void switch_proc(ProcSwitchReason reason);
 void start_scheduler();
+void init_cpu_scheduler(uint16_t id, uint64_t stack_top);
+bool scheduler_is_running();
+bool get_cpu_online(uint16_t id);
 void save_context_registers();
 void save_return_address_interrupt();
 void init_main_process();
 process_t* init_process();
+//Releases everything the process owns and puts its slot up for reuse. Also undoes init_process for one that failed to load
+void discard_process(process_t *proc);
 void save_syscall_return(uint64_t value);
 void process_restore();
+void fpu_kernel_enter();
+void fpu_kernel_exit();
+void fpu_trap();
 
 void stop_process(uint16_t pid);
 void stop_current_process();
@@ -26,7 +47,6 @@ void stop_current_process();
 void name_process(process_t *proc, const char *name);
 
 void sleep_process(uint64_t msec);
-void wake_processes();
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,13 +56,24 @@ process_t* get_current_proc();
 process_t* get_proc_by_pid(uint16_t pid);
 uint16_t get_current_proc_pid();
 
+input_buffer_t* get_input_buffer(process_t *proc);
+packet_buffer_t* get_packet_buffer(process_t *proc);
+
 uintptr_t get_current_heap();
+void* process_alloc(process_t *proc, uint64_t size, uint16_t alignment, bool zero);
+void process_free(process_t *proc, void *ptr, uint64_t size);
 bool get_current_privilege();
+
+void enqueue_process(process_t *proc);
+void set_process_priority(process_t *proc, uint8_t priority);
+void reprioritize_process(process_t *proc);
+scheduler_stats get_scheduler_stats();
 #ifdef __cplusplus
 }
 #endif
 
 uint16_t process_count();
-process_t *get_all_processes();
+uint32_t process_table_size();
+process_t *get_process_at(uint32_t index);
 
-extern uint64_t ksp;
\ No newline at end of file
+uint64_t get_ksp();
\ No newline at end of file
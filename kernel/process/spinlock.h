@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+
+//Ticket lock. Waiters are served in arrival order and sleep in wfe until the holder signals with sev
+typedef struct {
+    volatile uint32_t next;
+    volatile uint32_t serving;
+} spinlock_t;
+
+static inline void spin_lock(spinlock_t *lock){
+    uint32_t ticket, tmp, status;
+    asm volatile (
+        "1: ldaxr %w0, [%3]\n"
+        "   add %w1, %w0, #1\n"
+        "   stxr %w2, %w1, [%3]\n"
+        "   cbnz %w2, 1b\n"
+        : "=&r"(ticket), "=&r"(tmp), "=&r"(status)
+        : "r"(&lock->next)
+        : "memory");
+    while (1){
+        uint32_t serving;
+        asm volatile ("ldar %w0, [%1]" : "=r"(serving) : "r"(&lock->serving) : "memory");
+        if (serving == ticket) break;
+        asm volatile ("wfe");
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock){
+    asm volatile (
+        "stlr %w0, [%1]\n"
+        "dsb ish\n"
+        "sev\n"
+        :: "r"(lock->serving + 1), "r"(&lock->serving)
+        : "memory");
+}
+
+static inline bool spin_contended(spinlock_t *lock){
+    return (lock->next - lock->serving) > 1;
+}
@@ -13,154 +13,370 @@
 #include "std/string.h"
 #include "exceptions/timer.h"
 #include "networking/network.h"
+#include "hw/smp.h"
+#include "process/waitqueue.h"
+#include "process/process_events.h"
+#include "syscalls/syscall_ring.h"
+#include "memory/mmu.h"
+#include "process/demand_paging.h"
+
+//Parks the current process on wq and rewinds it to its svc, so the syscall runs again once it's woken up
+static void block_syscall(wait_queue *wq, uint64_t timeout_msec, uint64_t x0){
+    get_current_proc()->pc -= 4;
+    save_syscall_return(x0);
+    wait_queue_block(wq, timeout_msec);
+}
+
+//Results for a user process are copied out to pages of its own and the kernel's copy freed, so no allocator state
+//sharing a page with them is ever mapped into it. Kernel processes share the kernel's addresses and get the pointer as is
+static uint64_t user_copy_out(process_t *proc, void *ptr, uint64_t size){
+    if (!ptr || !proc->page_table) return (uintptr_t)ptr;
+    uintptr_t va = demand_copy_out(proc, ptr, size);
+    process_free(proc, ptr, size);
+    return va;
+}
+
+//Everything a user process allocates is page granular, see demand_paging.c
+static uint64_t sys_malloc(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    if (proc->page_table)
+        return demand_reserve(proc, x0);
+    if (!proc->heap){
+        handle_exception_with_info("Wrong process heap state", 0);
+    }
+    return (uintptr_t)process_alloc(proc, x0, ALIGN_16B, true);
+}
+
+static uint64_t sys_free(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    if (proc->page_table){
+        demand_release(proc, x0, x1);
+        return 0;
+    }
+    process_free(proc, (void*)x0, x1);
+    return 0;
+}
+
+//Backs user space allocators with page aligned, zeroed memory. User processes get a reservation that fills in as
+//it's touched, kernel processes whole pages from their heap
+static uint64_t sys_map_pages(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    if (!x0) return 0;
+    if (proc->page_table)
+        return demand_reserve(proc, x0);
+    return (uintptr_t)process_alloc(proc, (x0 + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1), ALIGN_4KB, true);
+}
+
+static uint64_t sys_unmap_pages(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    if (proc->page_table)
+        demand_release(proc, x0, x1);
+    else
+        process_free(proc, (void*)x0, x1);
+    return 0;
+}
+
+static uint64_t sys_printl(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    kprint((const char *)x0);
+    return 0;
+}
+
+static uint64_t sys_read_key(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    return sys_read_input_current((keypress*)x0);
+}
+
+static uint64_t sys_read_key_wait(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    input_buffer_t *buf = get_input_buffer(proc);
+    if (sys_read_input_current((keypress*)x0)){
+        wait_finish(proc);
+        return true;
+    }
+    if (!buf || wait_timed_out(proc))
+        return false;
+    block_syscall(&buf->readers, x1, x0);
+    return false;
+}
+
+static uint64_t sys_wait_events(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    uint32_t ready = process_ready_events(proc, x0);
+    if (ready){
+        wait_finish(proc);
+        proc->event_mask = 0;
+        return ready;
+    }
+    if (wait_timed_out(proc)){
+        proc->event_mask = 0;
+        return EVENT_TIMEOUT;
+    }
+    proc->event_mask = x0;
+    block_syscall(&proc->event_waiters, x1, x0);
+    return 0;
+}
+
+static uint64_t sys_clear_screen(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    if (!screen_overlay)
+        gpu_clear(x0);
+    return 0;
+}
+
+static uint64_t sys_draw_pixel(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    if (!screen_overlay)
+        gpu_draw_pixel(*(gpu_point*)x0,x1);
+    return 0;
+}
+
+static uint64_t sys_draw_line(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    if (!screen_overlay)
+        gpu_draw_line(*(gpu_point*)x0,*(gpu_point*)x1,x2);
+    return 0;
+}
+
+static uint64_t sys_draw_rect(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    if (!screen_overlay)
+        gpu_fill_rect(*(gpu_rect*)x0,x1);
+    return 0;
+}
+
+static uint64_t sys_draw_char(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    if (!screen_overlay)
+        gpu_draw_char(*(gpu_point*)x0,(char)x1,x2,x3);
+    return 0;
+}
+
+static uint64_t sys_draw_string(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    if (!screen_overlay)
+        gpu_draw_string(*(string *)x0,*(gpu_point*)x1,x2,x3);
+    return 0;
+}
+
+static uint64_t sys_gpu_flush(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    if (!screen_overlay)
+        gpu_flush();
+    return 0;
+}
+
+static uint64_t sys_screen_size(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    gpu_size size = gpu_get_screen_size();
+    if (proc->page_table)
+        return demand_copy_out(proc, &size, sizeof(gpu_size));
+    void *result = kalloc((void*)get_current_heap(), sizeof(gpu_size), ALIGN_16B, true, false);
+    memcpy(result, &size, sizeof(gpu_size));
+    return (uintptr_t)result;
+}
+
+static uint64_t sys_char_size(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    return gpu_get_char_size(x0);
+}
+
+static uint64_t sys_sleep(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    sleep_process(x0);
+    return 0;
+}
+
+static uint64_t sys_yield(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    switch_proc(YIELD);
+    return 0;
+}
+
+static uint64_t sys_halt(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    stop_current_process();
+    return 0;
+}
+
+static uint64_t sys_get_time(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    return timer_now_msec();
+}
+
+static uint64_t sys_get_pid(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    return get_current_proc_pid();
+}
+
+static uint64_t sys_bind_port(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    return network_bind_port(x0, get_current_proc_pid());
+}
+
+static uint64_t sys_unbind_port(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    return network_unbind_port(x0, get_current_proc_pid());
+}
+
+static uint64_t sys_send_packet(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    network_send_packet(x0, x1, (network_connection_ctx*)x2, (void*)x3, x4);
+    return 0;
+}
+
+static bool read_packet(sizedptr *packet){
+    if (!network_read_packet_current(packet))
+        return false;
+    packet->ptr = user_copy_out(get_current_proc(), (void*)packet->ptr, packet->size);
+    return true;
+}
+
+static uint64_t sys_read_packet(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    return read_packet((sizedptr*)x0);
+}
+
+static uint64_t sys_read_packet_wait(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    packet_buffer_t *buf = get_packet_buffer(proc);
+    if (read_packet((sizedptr*)x0)){
+        wait_finish(proc);
+        return true;
+    }
+    if (!buf || wait_timed_out(proc))
+        return false;
+    block_syscall(&buf->readers, x1, x0);
+    return false;
+}
+
+_Static_assert(sizeof(syscall_ring) <= PAGE_SIZE, "The syscall ring must fit in one page");
+
+//A user process' ring is a page of its own, shared through its heap window and freed with the process
+static uint64_t sys_ring_setup(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    process_t *proc = get_current_proc();
+    if (!proc->page_table){
+        if (!proc->ring)
+            proc->ring = (syscall_ring*)process_alloc(proc, sizeof(syscall_ring), ALIGN_64B, true);
+        return (uintptr_t)proc->ring;
+    }
+    if (!proc->ring){
+        proc->ring = (syscall_ring*)kalloc_zeroed(0, PAGE_SIZE, ALIGN_4KB, true, false);
+        if (!proc->ring) return 0;
+        mmu_map_user(proc->page_table, USER_HEAP_BASE + (uintptr_t)proc->ring, (uintptr_t)proc->ring, false);
+    }
+    return USER_HEAP_BASE + (uintptr_t)proc->ring;
+}
+
+//Runs every queued submission through the syscall table while there's room for its completion.
+//A sleep completes first and then puts the process to sleep, leaving the rest of the queue for the next call
+static uint64_t sys_ring_enter(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4){
+    syscall_ring *ring = get_current_proc()->ring;
+    if (!ring) return 0;
+    uint32_t done = 0;
+    while (ring->sq_head != ring->sq_tail && ring->cq_tail - ring->cq_head < RING_ENTRIES){
+        ring_sqe sqe = ring->sq[ring->sq_head % RING_ENTRIES];
+        ring->sq_head++;
+
+        uint64_t result = RING_EINVAL;
+        if (sqe.opcode == SYSCALL_SLEEP)
+            result = 0;
+        else if (sqe.opcode < SYSCALL_COUNT && syscall_table[sqe.opcode].handler && !(syscall_table[sqe.opcode].flags & SYSCALL_NORING))
+            result = syscall_table[sqe.opcode].handler(sqe.args[0], sqe.args[1], sqe.args[2], sqe.args[3], sqe.args[4]);
+
+        ring_cqe *cqe = &ring->cq[ring->cq_tail % RING_ENTRIES];
+        cqe->user_data = sqe.user_data;
+        cqe->result = result;
+        asm volatile ("dmb ish" ::: "memory");
+        ring->cq_tail++;
+        done++;
+
+        if (sqe.opcode == SYSCALL_SLEEP){
+            save_syscall_return(done);
+            sleep_process(sqe.args[0]);
+        }
+    }
+    return done;
+}
+
+//Indexed by the svc immediate. Leaf syscalls never block or switch process, so the entry stub runs them
+//straight away without saving the process context, see syscall_as.S
+syscall_entry syscall_table[SYSCALL_COUNT] = {
+    [0]  = { sys_malloc, SYSCALL_LEAF },
+    [1]  = { sys_free, SYSCALL_LEAF },
+    [2]  = { sys_map_pages, SYSCALL_LEAF },
+    [3]  = { sys_printl, 0 },
+    [4]  = { sys_unmap_pages, SYSCALL_LEAF },
+    [5]  = { sys_read_key, 0 },
+    [8]  = { sys_read_key_wait, SYSCALL_NORING },
+    [9]  = { sys_wait_events, SYSCALL_NORING },
+    [10] = { sys_clear_screen, 0 },
+    [11] = { sys_draw_pixel, 0 },
+    [12] = { sys_draw_line, 0 },
+    [13] = { sys_draw_rect, 0 },
+    [14] = { sys_draw_char, 0 },
+    [15] = { sys_draw_string, 0 },
+    [20] = { sys_gpu_flush, 0 },
+    [21] = { sys_screen_size, 0 },
+    [22] = { sys_char_size, 0 },
+    [30] = { sys_sleep, SYSCALL_NORING },
+    [31] = { sys_yield, SYSCALL_NORING },
+    [33] = { sys_halt, SYSCALL_NORING },
+    [40] = { sys_get_time, SYSCALL_LEAF },
+    [41] = { sys_get_pid, SYSCALL_LEAF },
+    [51] = { sys_bind_port, 0 },
+    [52] = { sys_unbind_port, 0 },
+    [53] = { sys_send_packet, 0 },
+    [54] = { sys_read_packet, 0 },
+    [55] = { sys_read_packet_wait, SYSCALL_NORING },
+    [60] = { sys_ring_setup, 0 },
+    [61] = { sys_ring_enter, SYSCALL_NORING },
+};
+
+//Called by the entry stub on the core's kernel stack, which it switches to from the caller's, with interrupts still masked
+uint64_t syscall_fast_entry(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4, syscall_fn handler){
+    bool locked = kernel_lock_held();
+    if (!locked)
+        kernel_lock();
+    fpu_kernel_enter();
+    uint64_t result = handler(x0, x1, x2, x3, x4);
+    fpu_kernel_exit();
+    if (!locked)
+        kernel_unlock();
+    return result;
+}
 
 void sync_el0_handler_c(){
+    //The entry stub has already moved to the kernel stack
     save_context_registers();
     save_return_address_interrupt();
     
-    if (ksp > 0)
-        asm volatile ("mov sp, %0" :: "r"(ksp));
-    uint64_t x0;
-    asm volatile ("mov %0, x15" : "=r"(x0));
-    uint64_t x1;
-    asm volatile ("mov %0, x14" : "=r"(x1));
-    uint64_t x2;
-    asm volatile ("mov %0, x9" : "=r"(x2));
-    uint64_t x3;
-    asm volatile ("mov %0, x16" : "=r"(x3));
-    uint64_t x4;
-    asm volatile ("mov %0, x4" : "=r"(x4));
-    uint64_t x29;
-    asm volatile ("mov %0, x13" : "=r"(x29));
-    uint64_t x30;
-    asm volatile ("mov %0, x12" : "=r"(x30));
-    uint64_t elr;
-    asm volatile ("mrs %0, elr_el1" : "=r"(elr));
+    kernel_lock();
+    fpu_kernel_enter();
+
     uint64_t spsr;
     asm volatile ("mrs %0, spsr_el1" : "=r"(spsr));
-
     uint64_t currentEL = (spsr >> 2) & 3;
 
-    uint64_t sp_el;
-    asm volatile ("mov %0, x11" : "=r"(sp_el));
-
     uint64_t esr;
     asm volatile ("mrs %0, esr_el1" : "=r"(esr));
 
     uint64_t ec = (esr >> 26) & 0x3F;
     uint64_t iss = esr & 0xFFFFFF;
     
+    if (ec == 0x07){
+        fpu_trap();
+        process_restore();
+    }
+
     uint64_t result = 0;
     if (ec == 0x15) {
-        switch (iss)
-        {
-        case 0:
-            void* page_ptr = (void*)get_current_heap();
-            if ((uintptr_t)page_ptr == 0x0){
-                handle_exception_with_info("Wrong process heap state", iss);
-            }
-            result = (uintptr_t)kalloc(page_ptr, x0, ALIGN_16B, get_current_privilege(), false);
-            break;
-        case 1:
-            kfree((void*)x0, x1);
-            break;
-        case 3:
-            kprint((const char *)x0);
-            break;
-
-        case 5:
-            keypress *kp = (keypress*)x0;
-            result = sys_read_input_current(kp);
-            break;
-
-        case 10:
-            if (!screen_overlay)
-                gpu_clear(x0);
-            break;
-
-        case 11:
-            if (!screen_overlay)
-                gpu_draw_pixel(*(gpu_point*)x0,x1);
-            break;
-
-        case 12:
-            if (!screen_overlay)
-                gpu_draw_line(*(gpu_point*)x0,*(gpu_point*)x1,x2);
-            break;
-
-        case 13:
-            if (!screen_overlay)
-                gpu_fill_rect(*(gpu_rect*)x0,x1);
-            break;
-
-        case 14:
-            if (!screen_overlay)
-                gpu_draw_char(*(gpu_point*)x0,(char)x1,x2,x3);
-            break;
-
-        case 15:
-            if (!screen_overlay){
-                gpu_draw_string(*(string *)x0,*(gpu_point*)x1,x2,x3);
-            }
-            break;
-
-        case 20:
-            if (!screen_overlay)
-                gpu_flush();
-            break;
-
-        case 21:
-            result = (uintptr_t)kalloc((void*)get_current_heap(), sizeof(gpu_size), ALIGN_16B, get_current_privilege(), false);
-            gpu_size size = gpu_get_screen_size();
-            memcpy((void*)result, &size, sizeof(gpu_size));
-            break;
-
-        case 22:
-            result = gpu_get_char_size(x0);
-            break;
-
-        case 30:
-            sleep_process(x0);
-            break;
-        
-        case 33:
-            stop_current_process();
-            break;
-
-        case 40:
-            result = timer_now_msec();
-            break;
-
-        case 51:
-            result = network_bind_port(x0, get_current_proc_pid());
-            break;
-
-        case 52:
-            result = network_unbind_port(x0, get_current_proc_pid());
-            break;
-
-        case 53:
-            network_connection_ctx *ctx = (network_connection_ctx*)x2;
-            void* payload = (void*)x3;
-            network_send_packet(x0, x1, ctx, payload, x4);
-            break;
-
-        case 54:
-            sizedptr *ptr = (sizedptr*)x0;
-            result = network_read_packet_current(ptr);
-            break;
-        
-        default:
+        //The entry stubs leave x0-x3 in x15, x14, x9 and x16 before the context is saved (regs[n] holds x(n+1))
+        process_t *proc = get_current_proc();
+        uint64_t x0 = proc->regs[14];
+        uint64_t x1 = proc->regs[13];
+        uint64_t x2 = proc->regs[8];
+        uint64_t x3 = proc->regs[15];
+        uint64_t x4 = proc->regs[3];
+        if (iss >= SYSCALL_COUNT || !syscall_table[iss].handler)
             handle_exception_with_info("Unknown syscall", iss);
-            break;
-        }
+        else
+            result = syscall_table[iss].handler(x0, x1, x2, x3, x4);
     } else {
-        //We could handle more exceptions now, such as x25 (unmasked x96) = data abort
+        uint64_t far;
+        asm volatile ("mrs %0, far_el1" : "=r"(far));
+        process_t *proc = get_current_proc();
+        //First touch of a stack or reserved page, the faulting instruction runs again once it's mapped
+        if (demand_page_fault(proc, esr, far))
+            process_restore();
+        if (demand_stack_overflow(proc, far))
+            kprintf("Stack overflow in %s", (uintptr_t)proc->name);
         if (currentEL == 1)
             handle_exception_with_info("UNEXPECTED EXCEPTION",ec);
         else {
-            uint64_t far;
-            asm volatile ("mrs %0, far_el1" : "=r"(far));
+            uint64_t elr;
+            asm volatile ("mrs %0, elr_el1" : "=r"(elr));
             kprintf("Process has crashed. ESR: %x. ELR: %x. FAR: %x", esr, elr, far);
             stop_current_process();
         }
@@ -169,3 +385,12 @@ void sync_el0_handler_c(){
     process_restore();
 }
 
+//Data abort from kernel code that is already handling an exception, usually a syscall writing to user memory
+//that hasn't been touched yet. The entry stub saved the registers, so it returns straight to the access
+void kernel_data_abort(){
+    uint64_t esr, far;
+    asm volatile ("mrs %0, esr_el1" : "=r"(esr));
+    asm volatile ("mrs %0, far_el1" : "=r"(far));
+    if (!demand_page_fault(get_current_proc(), esr, far))
+        handle_exception_with_info("Kernel data abort", far);
+}
@@ -2,3 +2,26 @@
 
 #include "types.h"
 
+//Syscall ABI
+//  svc #n selects syscall n, there's no number register
+//  Arguments go in x0-x4 and the result comes back in x0
+//  Syscalls are called like functions, so the caller must treat x0-x18 and x30 as clobbered.
+//  The entry stubs use x9-x16 and x18 as scratch, and x29 holds sp on return from the full path
+//  Leaf syscalls run on the core's kernel stack without a context save. They must not block, sleep or switch process
+
+#define SYSCALL_COUNT 64
+#define SYSCALL_LEAF (1 << 0)
+//May block, switch process or enter the ring itself, so it can't be used as a ring opcode
+#define SYSCALL_NORING (1 << 1)
+
+#define SYSCALL_SLEEP 30
+
+typedef uint64_t (*syscall_fn)(uint64_t x0, uint64_t x1, uint64_t x2, uint64_t x3, uint64_t x4);
+
+//16 bytes each, syscall_as.S indexes this table directly
+typedef struct {
+    syscall_fn handler;
+    uint64_t flags;
+} syscall_entry;
+
+extern syscall_entry syscall_table[SYSCALL_COUNT];
@@ -0,0 +1,65 @@
+#include "waitqueue.h"
+#include "scheduler.h"
+#include "console/kio.h"
+
+void wait_queue_remove(process_t *proc){
+    wait_queue *wq = proc->waiting_on;
+    if (!wq) return;
+    process_t **slot = &wq->head;
+    while (*slot && *slot != proc)
+        slot = &(*slot)->wait_next;
+    if (*slot)
+        *slot = proc->wait_next;
+    proc->wait_next = NULL;
+    proc->waiting_on = NULL;
+}
+
+static void wait_timeout(void *ctx){
+    process_t *proc = (process_t*)ctx;
+    proc->wait_expired = true;
+    if (proc->waiting_on){
+        wait_queue_remove(proc);
+        enqueue_process(proc);
+    }
+}
+
+//Blocks the current process until the queue is woken up or the timeout passes, 0 waits forever.
+//Never returns: the process resumes at its saved pc, so syscalls rewind it to re-issue themselves.
+//The timeout stays armed across those restarts, so it's only set the first time
+void wait_queue_block(wait_queue *wq, uint64_t timeout_msec){
+    process_t *proc = get_current_proc();
+    if (timeout_msec && !proc->sleep_timer.armed){
+        ktimer_init(&proc->sleep_timer, wait_timeout, proc);
+        if (!ktimer_arm(&proc->sleep_timer, timeout_msec))
+            kprintf("[scheduler error] No memory left for the wait timeout of process %i, it waits without one", proc->id);
+    }
+    proc->state = BLOCKED;
+    proc->waiting_on = wq;
+    proc->wait_next = wq->head;
+    wq->head = proc;
+    switch_proc(YIELD);
+}
+
+void wait_queue_wake_all(wait_queue *wq){
+    process_t *proc = wq->head;
+    wq->head = NULL;
+    while (proc){
+        process_t *next = proc->wait_next;
+        proc->wait_next = NULL;
+        proc->waiting_on = NULL;
+        enqueue_process(proc);
+        proc = next;
+    }
+}
+
+bool wait_timed_out(process_t *proc){
+    bool expired = proc->wait_expired;
+    proc->wait_expired = false;
+    return expired;
+}
+
+//Called once the awaited event has been consumed, drops any pending timeout
+void wait_finish(process_t *proc){
+    ktimer_cancel(&proc->sleep_timer);
+    proc->wait_expired = false;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct process;
+
+//Processes blocked until some event, linked through process_t.wait_next
+typedef struct wait_queue {
+    struct process *head;
+} wait_queue;
+
+void wait_queue_block(wait_queue *wq, uint64_t timeout_msec);
+void wait_queue_wake_all(wait_queue *wq);
+void wait_queue_remove(struct process *proc);
+bool wait_timed_out(struct process *proc);
+void wait_finish(struct process *proc);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "types.h"
+
+//Event sources for wait_events. The same bits come back as the ready mask
+#define EVENT_INPUT     (1 << 0)
+#define EVENT_PACKET    (1 << 1)
+//Reserved for audio buffer space
+#define EVENT_AUDIO     (1 << 2)
+//Returned alone when the deadline passes with nothing ready
+#define EVENT_TIMEOUT   (1u << 31)
@@ -2,7 +2,7 @@
 
 uint16_t checksum16(uint16_t *data, size_t len) {
     uint32_t sum = 0;
-    for (int i = 0; i < len; i++) sum += data[i];
+    for (size_t i = 0; i < len; i++) sum += data[i];
     while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
     return ~sum;
 }
@@ -72,13 +72,9 @@ void tcp_reset(uint16_t port, network_connection_ctx *destination, tcp_data* dat
 }
 
 bool tcp_expect_response(sizedptr *pack){
-    uint16_t timeout = 10;
-    while (!read_packet(pack)){
-        sleep(1000);
-        if (timeout-- == 0){
-            printf("Response timeout");
-            return false;
-        }
+    if (!read_packet_wait(pack, 10000)){
+        printf("Response timeout");
+        return false;
     }
     return true;
 }
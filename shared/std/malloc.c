@@ -0,0 +1,73 @@
+#include "syscalls/syscalls.h"
+#include "std/memfunctions.h"
+
+//Same power of two classes as the kernel's kalloc, from 16 to 2048 bytes. Anything bigger gets its own pages
+#define HEAP_MIN_CLASS 16
+#define HEAP_CLASSES 8
+#define HEAP_MAX_CLASS (HEAP_MIN_CLASS << (HEAP_CLASSES - 1))
+//Blocks are carved from chunks this big. The kernel only commits the pages that get touched
+#define HEAP_CHUNK_SIZE 0x10000
+
+typedef struct heap_block {
+    struct heap_block *next;
+} heap_block;
+
+//Processes run a single thread, so the per class free lists are the whole cache and need no locking
+static heap_block *free_lists[HEAP_CLASSES];
+static uintptr_t chunk_next;
+static uintptr_t chunk_end;
+
+static inline int heap_class(size_t size){
+    if (size <= HEAP_MIN_CLASS) return 0;
+    return 64 - __builtin_clzll(size - 1) - 4;
+}
+
+//Whatever is left of the old chunk is split into blocks of the biggest classes that fit, so it isn't lost
+static bool heap_refill(){
+    while (chunk_end - chunk_next >= HEAP_MIN_CLASS){
+        int c = heap_class(chunk_end - chunk_next + 1) - 1;
+        heap_block *block = (heap_block*)chunk_next;
+        block->next = free_lists[c];
+        free_lists[c] = block;
+        chunk_next += HEAP_MIN_CLASS << c;
+    }
+    uintptr_t chunk = (uintptr_t)map_pages(HEAP_CHUNK_SIZE);
+    if (!chunk) return false;
+    chunk_next = chunk;
+    chunk_end = chunk + HEAP_CHUNK_SIZE;
+    return true;
+}
+
+//Memory is zeroed like the kernel's allocations always were. Fresh chunk memory already is
+uintptr_t malloc(size_t size){
+    if (!size) return 0;
+    if (size > HEAP_MAX_CLASS)
+        return (uintptr_t)map_pages(size);
+
+    int c = heap_class(size);
+    heap_block *block = free_lists[c];
+    if (block){
+        free_lists[c] = block->next;
+        memset(block, 0, size);
+        return (uintptr_t)block;
+    }
+
+    uint64_t block_size = HEAP_MIN_CLASS << c;
+    if (chunk_end - chunk_next < block_size && !heap_refill())
+        return 0;
+    uintptr_t result = chunk_next;
+    chunk_next += block_size;
+    return result;
+}
+
+void free(void *ptr, size_t size){
+    if (!ptr || !size) return;
+    if (size > HEAP_MAX_CLASS){
+        unmap_pages(ptr, size);
+        return;
+    }
+    int c = heap_class(size);
+    heap_block *block = (heap_block*)ptr;
+    block->next = free_lists[c];
+    free_lists[c] = block;
+}
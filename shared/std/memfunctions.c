@@ -1,5 +1,10 @@
 #include "memfunctions.h"
 
+//aarch64 uses the versions in memfunctions_as.S. These are for other targets
+#ifndef __aarch64__
+
+uint8_t mem_device_access;
+
 int memcmp(const void *s1, const void *s2, unsigned long count) {
     const unsigned char *a = s1;
     const unsigned char *b = s2;
@@ -9,9 +14,8 @@ int memcmp(const void *s1, const void *s2, unsigned long count) {
     return 0;
 }
 
-void* memset(void* dest, uint32_t val, size_t count) {
+static void* memfill(void* dest, uint64_t pattern, size_t count) {
     uint64_t *d64 = (uint64_t *)dest;
-    uint64_t pattern = ((uint64_t)val << 32) | val;
 
     uint64_t blocks = count / 32;
     for (uint64_t i = 0; i < blocks; i++) {
@@ -26,12 +30,19 @@ void* memset(void* dest, uint32_t val, size_t count) {
     for (uint64_t i = 0; i < remaining; i++) d64[i] = pattern;
 
     uint8_t *d8 = (uint8_t *)(d64 + remaining);
-    uint8_t byte_val = val & 0xFF;
-    for (uint64_t i = 0; i < count % 8; i++) d8[i] = byte_val;
+    for (uint64_t i = 0; i < count % 8; i++) d8[i] = (uint8_t)(pattern >> (i * 8));
 
     return dest;
 }
 
+void* memset(void* dest, uint32_t val, size_t count) {
+    return memfill(dest, (val & 0xFF) * 0x0101010101010101ULL, count);
+}
+
+void* memset32(void* dest, uint32_t val, size_t count) {
+    return memfill(dest, ((uint64_t)val << 32) | val, count);
+}
+
 void* memcpy(void *dest, const void *src, uint64_t count) {
     uint64_t *d64 = (uint64_t *)dest;
     const uint64_t *s64 = (const uint64_t *)src;
@@ -54,4 +65,18 @@ void* memcpy(void *dest, const void *src, uint64_t count) {
     for (uint64_t i = 0; i < count % 8; i++) d8[i] = s8[i];
 
     return dest;
-}
\ No newline at end of file
+}
+
+void* memmove(void *dest, const void *src, uint64_t count) {
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+    if (d == s || !count) return dest;
+    if (d < s || d >= s + count) {
+        for (uint64_t i = 0; i < count; i++) d[i] = s[i];
+    } else {
+        for (uint64_t i = count; i > 0; i--) d[i - 1] = s[i - 1];
+    }
+    return dest;
+}
+
+#endif
\ No newline at end of file
@@ -5,8 +5,16 @@ extern "C" {
 #include "types.h"
 
 int memcmp(const void *s1, const void *s2, unsigned long count);
+//Fills with the low byte of val
 void* memset(void* dest, uint32_t val, size_t count);
+//Fills with the whole 32 bit val. dest must be 4 byte aligned and count a multiple of 4
+void* memset32(void* dest, uint32_t val, size_t count);
 void* memcpy(void *dest, const void *src, uint64_t count);
+void* memmove(void *dest, const void *src, uint64_t count);
+
+//Keeps the functions above to aligned accesses. The kernel sets it while the MMU is off, when all memory
+//is Device-nGnRnE and unaligned or dc zva accesses fault
+extern uint8_t mem_device_access;
 
 #ifdef __cplusplus
 }
@@ -1,6 +1,7 @@
 #include "std/string.h"
 #include "syscalls/syscalls.h"
 #include "std/memfunctions.h"
+#include "std/string_builder.h"
 
 uint32_t strlen(const char *s, uint32_t max_length){
     if (s == NULL) return 0;
@@ -134,91 +135,20 @@ string string_format(const char *fmt, ...){
     return result;
 }
 
+//Built inline and copied out once at its final length, so there's no limit and one allocation per string
 string string_format_va(const char *fmt, va_list args){
-    char *buf = (char*)malloc(256);
-    size_t len = string_format_va_buf(fmt, buf, args);
-    return (string){ .data = buf, .length = len, .mem_length = 256 };
+    string_builder sb;
+    sb_init(&sb, NULL);
+    sb_format_va(&sb, fmt, args);
+    return sb_to_string(&sb);
 }
 
+//out must hold 256 bytes. Longer output is truncated, use string_format_va or a string_builder for that
 size_t string_format_va_buf(const char *fmt, char *buf, va_list args){
-    size_t len = 0;
-    for (uint32_t i = 0; fmt[i] && len < 255; i++){
-        if (fmt[i] == '%' && fmt[i+1]){
-            i++;
-            if (fmt[i] == 'x'){
-                uint64_t val = va_arg(args, uint64_t);
-                len += parse_hex(val,(char*)(buf + len));
-                
-            } else if (fmt[i] == 'b') {
-                uint64_t val = va_arg(args, uint64_t);
-                string bin = string_from_bin(val);
-                for(uint32_t j = 0; j < bin.length && len < 255; j++) buf[len++] = bin.data[j];
-                free(bin.data,bin.mem_length);
-                
-            } else if (fmt[i] == 'c') {
-                uint64_t val = va_arg(args, uint64_t);
-                buf[len++] = (char)val;
-                
-            } else if (fmt[i] == 's') {
-                 char *str = ( char *)va_arg(args, uintptr_t);
-                for (uint32_t j = 0; str[j] && len < 255; j++) buf[len++] = str[j];
-                
-            } else if (fmt[i] == 'i') {
-                uint64_t val = va_arg(args, long int);
-                char temp[21];
-                uint32_t temp_len = 0;
-            
-                if ((int)val < 0) {
-                    buf[len++] = '-';
-                    val = (uint64_t)(-(int)val);
-                }
-                
-                do {
-                    temp[temp_len++] = '0' + (val % 10);
-                    val /= 10;
-                } while (val && temp_len < 20);
-            
-                for (int j = temp_len - 1; j >= 0 && len < 255; j--){
-                    buf[len++] = temp[j];
-                }
-            } else if (fmt[i] == 'f' || fmt[i] == 'd') {
-                double val = va_arg(args, double);
-                if (val < 0){
-                    buf[len++] = '-';
-                    val = -val;
-                }
-                uint64_t whole = (uint64_t)val;
-                double frac = val - (double)whole;
-
-                char temp[21];
-                uint32_t temp_len = 0;
-                do {
-                    temp[temp_len++] = '0' +(whole % 10);
-                    whole /= 10;
-                } while(whole && temp_len < 20);
-
-                for (int j = temp_len - 1; j >= 0 && len < 255; j--){
-                    buf[len++] = temp[j];
-                }
-                if (len < 255) buf[len++] = '.';
-                
-                for (int d = 0; d < 6 && len < 255; d++) {
-                    frac *= 10;
-                    int digit = (int)frac;
-                    buf[len++] = '0' + digit;
-                    frac -= digit;
-                }
-            } else {
-                buf[len++] = '%';
-                buf[len++] = fmt[i];
-            }
-        } else {
-            buf[len++] = fmt[i];
-        }
-    }
-
-    buf[len]=0;
-    return len;
+    string_builder sb;
+    sb_init_buf(&sb, buf, 256, true);
+    sb_format_va(&sb, fmt, args);
+    return sb.length;
 }
 
 char tolower(char c){
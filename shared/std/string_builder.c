@@ -0,0 +1,415 @@
+#include "string_builder.h"
+#include "syscalls/syscalls.h"
+#include "std/memfunctions.h"
+
+void arena_init(string_arena *arena, size_t chunk_size){
+    *arena = (string_arena){ .chunk_size = chunk_size };
+}
+
+void* arena_alloc(string_arena *arena, size_t size){
+    size = (size + 15) & ~15ULL;
+    if (arena->end - arena->next < size){
+        size_t chunk_size = arena->chunk_size ? arena->chunk_size : STRING_ARENA_CHUNK;
+        if (chunk_size < size + sizeof(arena_chunk) + 15)
+            chunk_size = size + sizeof(arena_chunk) + 15;
+        arena_chunk *chunk = (arena_chunk*)malloc(chunk_size);
+        if (!chunk) return 0;
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        arena->chunks = chunk;
+        arena->next = ((uintptr_t)chunk + sizeof(arena_chunk) + 15) & ~15ULL;
+        arena->end = (uintptr_t)chunk + chunk_size;
+    }
+    void *result = (void*)arena->next;
+    arena->next += size;
+    return result;
+}
+
+void arena_reset(string_arena *arena){
+    arena_chunk *keep = arena->chunks;
+    if (!keep) return;
+    for (arena_chunk *chunk = keep->next; chunk;){
+        arena_chunk *next = chunk->next;
+        free(chunk, chunk->size);
+        chunk = next;
+    }
+    keep->next = 0;
+    arena->next = ((uintptr_t)keep + sizeof(arena_chunk) + 15) & ~15ULL;
+}
+
+void arena_release(string_arena *arena){
+    for (arena_chunk *chunk = arena->chunks; chunk;){
+        arena_chunk *next = chunk->next;
+        free(chunk, chunk->size);
+        chunk = next;
+    }
+    arena->chunks = 0;
+    arena->next = arena->end = 0;
+}
+
+void sb_init(string_builder *sb, string_arena *arena){
+    sb->data = sb->small;
+    sb->length = 0;
+    sb->capacity = STRING_BUILDER_INLINE;
+    sb->arena = arena;
+    sb->owned = false;
+    sb->fixed = false;
+    sb->small[0] = 0;
+}
+
+void sb_init_buf(string_builder *sb, char *buf, uint32_t size, bool fixed){
+    sb_init(sb, 0);
+    sb->fixed = fixed;
+    //Not even room for the terminator. buf is left alone and the inline storage holds the empty string instead
+    if (!size){
+        sb->capacity = 1;
+        return;
+    }
+    sb->data = buf;
+    sb->capacity = size;
+    buf[0] = 0;
+}
+
+//Capacity doubles, so appending n characters costs O(n) copies overall. The newest arena allocation grows in place
+bool sb_reserve(string_builder *sb, uint32_t extra){
+    uint64_t needed = (uint64_t)sb->length + extra + 1;
+    if (needed <= sb->capacity) return true;
+    if (sb->fixed || needed > UINT32_MAX) return false;
+    uint64_t capacity = (uint64_t)sb->capacity * 2;
+    if (capacity < needed) capacity = needed;
+    capacity = (capacity + 15) & ~15ULL;
+    if (capacity > UINT32_MAX) capacity = needed;
+
+    char *data;
+    if (sb->arena){
+        string_arena *arena = sb->arena;
+        uintptr_t start = (uintptr_t)sb->data;
+        if (start + sb->capacity == arena->next && arena->end - start >= capacity){
+            arena->next = start + capacity;
+            sb->capacity = capacity;
+            return true;
+        }
+        data = arena_alloc(arena, capacity);
+    } else {
+        data = (char*)malloc(capacity);
+    }
+    if (!data) return false;
+    memcpy(data, sb->data, sb->length + 1);
+    if (sb->owned)
+        free(sb->data, sb->capacity);
+    sb->owned = !sb->arena;
+    sb->data = data;
+    sb->capacity = capacity;
+    return true;
+}
+
+//Formatting appends a few characters at a time, which a plain loop copies faster than a memcpy call
+void sb_append(string_builder *sb, const char *s, uint32_t length){
+    if (sb->length + length >= sb->capacity && !sb_reserve(sb, length))
+        length = sb->capacity - sb->length - 1;
+    char *out = sb->data + sb->length;
+    if (length < 16){
+        for (uint32_t i = 0; i < length; i++) out[i] = s[i];
+    } else {
+        memcpy(out, s, length);
+    }
+    sb->length += length;
+    sb->data[sb->length] = 0;
+}
+
+void sb_append_cstr(string_builder *sb, const char *s){
+    sb_append(sb, s, strlen(s, 0));
+}
+
+void sb_append_c(string_builder *sb, char c){
+    if (sb->length + 1 >= sb->capacity && !sb_reserve(sb, 1)) return;
+    sb->data[sb->length++] = c;
+    sb->data[sb->length] = 0;
+}
+
+void sb_append_repeat(string_builder *sb, char c, uint32_t count){
+    if (!count) return;
+    if (sb->length + count >= sb->capacity && !sb_reserve(sb, count))
+        count = sb->capacity - sb->length - 1;
+    memset(sb->data + sb->length, c, count);
+    sb->length += count;
+    sb->data[sb->length] = 0;
+}
+
+typedef struct {
+    bool left;
+    bool zero;
+    uint32_t width;
+    int precision;
+} format_spec;
+
+//Sign and prefix (at most 2 characters) go before any zero padding, spaces go around everything
+static void sb_append_number(string_builder *sb, format_spec *spec, const char *prefix, const char *digits, uint32_t length){
+    uint32_t prefix_length = prefix[0] ? prefix[1] ? 2 : 1 : 0;
+    uint32_t zeros = spec->precision > 0 && (uint32_t)spec->precision > length ? spec->precision - length : 0;
+    uint32_t total = prefix_length + zeros + length;
+    uint32_t pad = spec->width > total ? spec->width - total : 0;
+    if (spec->zero && !spec->left){
+        zeros += pad;
+        pad = 0;
+    }
+    if (!spec->left) sb_append_repeat(sb, ' ', pad);
+    sb_append(sb, prefix, prefix_length);
+    sb_append_repeat(sb, '0', zeros);
+    sb_append(sb, digits, length);
+    if (spec->left) sb_append_repeat(sb, ' ', pad);
+}
+
+static void sb_append_padded(string_builder *sb, format_spec *spec, const char *s, uint32_t length){
+    uint32_t pad = spec->width > length ? spec->width - length : 0;
+    if (!spec->left) sb_append_repeat(sb, ' ', pad);
+    sb_append(sb, s, length);
+    if (spec->left) sb_append_repeat(sb, ' ', pad);
+}
+
+//Digits are written backwards from the end of buf, the return is where they start
+static char* format_unsigned(uint64_t value, char *end, uint32_t base){
+    char *p = end;
+    do {
+        uint32_t digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    return p;
+}
+
+//Digits start 21 in, and the largest double has a 309 digit whole part before the point and up to 17 decimals
+#define DOUBLE_FORMAT_MAX 352
+
+static void sb_append_double(string_builder *sb, format_spec *spec, double val){
+    format_spec number = *spec;
+    number.precision = -1;
+    if (val != val){
+        sb_append_padded(sb, spec, "nan", 3);
+        return;
+    }
+    const char *sign = "";
+    if (val < 0){
+        sign = "-";
+        val = -val;
+    }
+    if (val - val != 0){
+        number.zero = false;
+        sb_append_number(sb, &number, sign, "inf", 3);
+        return;
+    }
+
+    int precision = spec->precision < 0 ? 6 : spec->precision > 17 ? 17 : spec->precision;
+    char buf[DOUBLE_FORMAT_MAX];
+
+    //Past what the whole part can hold in 64 bits. The 15 significant digits every double keeps through the
+    //scaling down are printed, the rest of the whole part and the fraction are zeros
+    if (val >= 18446744073709551616.0){
+        int zeros = 0;
+        while (val >= 1e37){
+            val /= 1e22;
+            zeros += 22;
+        }
+        //Powers of ten up to 1e22 are exact doubles
+        double scale = 1;
+        while (val >= 1e15 * scale){
+            scale *= 10;
+            zeros++;
+        }
+        uint64_t digits = (uint64_t)(val / scale + 0.5);
+        if (digits >= 1000000000000000ULL){
+            digits /= 10;
+            zeros++;
+        }
+        char *end = buf + 21;
+        char *start = format_unsigned(digits, end, 10);
+        memset(end, '0', zeros);
+        end += zeros;
+        if (precision){
+            *end++ = '.';
+            memset(end, '0', precision);
+            end += precision;
+        }
+        sb_append_number(sb, &number, sign, start, end - start);
+        return;
+    }
+
+    double rounding = 0.5;
+    for (int d = 0; d < precision; d++) rounding /= 10;
+    val += rounding;
+    if (val >= 18446744073709551616.0) val -= rounding;
+
+    uint64_t whole = (uint64_t)val;
+    double frac = val - (double)whole;
+
+    char *end = buf + 21;
+    char *start = format_unsigned(whole, end, 10);
+    if (precision){
+        *end++ = '.';
+        for (int d = 0; d < precision; d++){
+            frac *= 10;
+            int digit = (int)frac;
+            if (digit > 9) digit = 9;
+            *end++ = '0' + digit;
+            frac -= digit;
+        }
+    }
+    sb_append_number(sb, &number, sign, start, end - start);
+}
+
+//%[-0][width][.precision]conversion, with width and precision also taken from the arguments as *.
+//Length modifiers are accepted and ignored, every integer argument is read as 64 bits.
+//i is signed decimal, u unsigned decimal, x hex and b binary with their prefixes, c a character, s a string,
+//f and d a double, 6 decimals unless a precision is given
+void sb_format_va(string_builder *sb, const char *fmt, va_list args){
+    while (*fmt){
+        const char *literal = fmt;
+        while (*fmt && *fmt != '%') fmt++;
+        if (fmt != literal) sb_append(sb, literal, fmt - literal);
+        if (!*fmt) break;
+
+        const char *percent = fmt++;
+        if (!*fmt){
+            sb_append_c(sb, '%');
+            break;
+        }
+        if (*fmt == '%'){
+            sb_append_c(sb, '%');
+            fmt++;
+            continue;
+        }
+
+        format_spec spec = { .precision = -1 };
+        for (;; fmt++){
+            if (*fmt == '-') spec.left = true;
+            else if (*fmt == '0') spec.zero = true;
+            else break;
+        }
+        if (*fmt == '*'){
+            int width = va_arg(args, int);
+            if (width < 0){
+                spec.left = true;
+                width = -width;
+            }
+            spec.width = width;
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') spec.width = spec.width * 10 + (*fmt++ - '0');
+        }
+        if (*fmt == '.'){
+            fmt++;
+            spec.precision = 0;
+            if (*fmt == '*'){
+                spec.precision = va_arg(args, int);
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') spec.precision = spec.precision * 10 + (*fmt++ - '0');
+            }
+        }
+        while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z') fmt++;
+
+        char buf[66];
+        char *end = buf + sizeof(buf);
+        char conversion = *fmt;
+        if (conversion) fmt++;
+        switch (conversion){
+            case 'x': {
+                char *start = format_unsigned(va_arg(args, uint64_t), end, 16);
+                sb_append_number(sb, &spec, "0x", start, end - start);
+                break;
+            }
+            case 'b': {
+                char *start = format_unsigned(va_arg(args, uint64_t), end, 2);
+                sb_append_number(sb, &spec, "0b", start, end - start);
+                break;
+            }
+            case 'u': {
+                char *start = format_unsigned(va_arg(args, uint64_t), end, 10);
+                sb_append_number(sb, &spec, "", start, end - start);
+                break;
+            }
+            //Negative when the low 32 bits are, since int arguments aren't sign extended to 64 bits
+            case 'i': {
+                uint64_t val = va_arg(args, long int);
+                const char *sign = "";
+                if ((int)val < 0){
+                    sign = "-";
+                    val = (uint64_t)(-(int64_t)(int)val);
+                }
+                char *start = format_unsigned(val, end, 10);
+                sb_append_number(sb, &spec, sign, start, end - start);
+                break;
+            }
+            case 'c': {
+                char c = (char)va_arg(args, uint64_t);
+                sb_append_padded(sb, &spec, &c, 1);
+                break;
+            }
+            case 's': {
+                const char *str = (const char*)va_arg(args, uintptr_t);
+                if (!str) str = "(null)";
+                uint32_t length = strlen(str, spec.precision > 0 ? spec.precision : 0);
+                if (spec.precision == 0) length = 0;
+                sb_append_padded(sb, &spec, str, length);
+                break;
+            }
+            case 'f':
+            case 'd':
+                sb_append_double(sb, &spec, va_arg(args, double));
+                break;
+            default:
+                sb_append(sb, percent, fmt - percent);
+                break;
+        }
+    }
+}
+
+void sb_format(string_builder *sb, const char *fmt, ...){
+    va_list args;
+    va_start(args, fmt);
+    sb_format_va(sb, fmt, args);
+    va_end(args);
+}
+
+void sb_clear(string_builder *sb){
+    sb->length = 0;
+    sb->data[0] = 0;
+}
+
+string sb_to_string(string_builder *sb){
+    string result = { .data = sb->data, .length = sb->length, .mem_length = sb->owned ? sb->capacity : 0 };
+    if (!sb->owned && (!sb->arena || sb->data == sb->small)){
+        //Inline or caller supplied storage stays with the builder, so the string gets a copy
+        char *copy = sb->arena ? arena_alloc(sb->arena, sb->length + 1) : (char*)malloc(sb->length + 1);
+        if (!copy) return (string){ .data = NULL, .length = 0, .mem_length = 0 };
+        memcpy(copy, sb->data, sb->length + 1);
+        result.data = copy;
+        result.mem_length = sb->arena ? 0 : sb->length + 1;
+    } else {
+        sb->data = sb->small;
+        sb->capacity = STRING_BUILDER_INLINE;
+        sb->owned = false;
+    }
+    sb_clear(sb);
+    return result;
+}
+
+void sb_free(string_builder *sb){
+    if (sb->owned)
+        free(sb->data, sb->capacity);
+    sb->owned = false;
+    sb->data = sb->small;
+    sb->capacity = STRING_BUILDER_INLINE;
+    sb->fixed = false;
+    sb_clear(sb);
+}
+
+string string_format_arena(string_arena *arena, const char *fmt, ...){
+    string_builder sb;
+    sb_init(&sb, arena);
+    va_list args;
+    va_start(args, fmt);
+    sb_format_va(&sb, fmt, args);
+    va_end(args);
+    return sb_to_string(&sb);
+}
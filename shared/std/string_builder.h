@@ -0,0 +1,71 @@
+#pragma once
+
+#include "types.h"
+#include "args.h"
+#include "std/string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STRING_BUILDER_INLINE 64
+#define STRING_ARENA_CHUNK 0x1000
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+} arena_chunk;
+
+//Bump allocator for short lived strings, everything in it is freed at once by arena_reset or arena_release.
+//Zero initialized is a valid empty arena that allocates STRING_ARENA_CHUNK sized chunks
+typedef struct string_arena {
+    arena_chunk *chunks;
+    uintptr_t next;
+    uintptr_t end;
+    size_t chunk_size;
+} string_arena;
+
+void arena_init(string_arena *arena, size_t chunk_size);
+void* arena_alloc(string_arena *arena, size_t size);
+//Frees everything allocated from the arena but keeps its newest chunk for reuse
+void arena_reset(string_arena *arena);
+void arena_release(string_arena *arena);
+
+//Growable, always null terminated buffer. Short strings live in the builder itself, longer ones move to the heap,
+//or to the arena if one is given. Builders using their inline storage can't be copied, pass them by pointer
+typedef struct string_builder {
+    char *data;
+    uint32_t length;
+    uint32_t capacity;
+    string_arena *arena;
+    //data came from malloc and is freed by the builder
+    bool owned;
+    //Fixed builders truncate instead of growing
+    bool fixed;
+    char small[STRING_BUILDER_INLINE];
+} string_builder;
+
+void sb_init(string_builder *sb, string_arena *arena);
+//Starts out in buf. If fixed, output past size is dropped, otherwise it moves to the heap
+void sb_init_buf(string_builder *sb, char *buf, uint32_t size, bool fixed);
+//Makes room for extra more characters. Returns false if it couldn't
+bool sb_reserve(string_builder *sb, uint32_t extra);
+void sb_append(string_builder *sb, const char *s, uint32_t length);
+void sb_append_cstr(string_builder *sb, const char *s);
+void sb_append_c(string_builder *sb, char c);
+void sb_append_repeat(string_builder *sb, char c, uint32_t count);
+//Same conversions as string_format
+void sb_format(string_builder *sb, const char *fmt, ...);
+void sb_format_va(string_builder *sb, const char *fmt, va_list args);
+void sb_clear(string_builder *sb);
+//Hands the contents over as a string and leaves the builder empty. Heap strings are freed with free(data, mem_length).
+//Arena strings have a mem_length of 0 and go away with the arena
+string sb_to_string(string_builder *sb);
+void sb_free(string_builder *sb);
+
+//string_format into an arena, with no separate allocation per string
+string string_format_arena(string_arena *arena, const char *fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
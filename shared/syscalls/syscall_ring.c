@@ -0,0 +1,28 @@
+#include "syscall_ring.h"
+
+//Queues one syscall. Returns false when the submission queue is full, call ring_enter to drain it
+bool ring_push(syscall_ring *ring, uint32_t opcode, uint64_t user_data, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4){
+    if (ring->sq_tail - ring->sq_head >= RING_ENTRIES) return false;
+    ring_sqe *sqe = &ring->sq[ring->sq_tail % RING_ENTRIES];
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    sqe->args[0] = a0;
+    sqe->args[1] = a1;
+    sqe->args[2] = a2;
+    sqe->args[3] = a3;
+    sqe->args[4] = a4;
+    asm volatile ("dmb ish" ::: "memory");
+    ring->sq_tail++;
+    return true;
+}
+
+ring_cqe* ring_peek_cqe(syscall_ring *ring){
+    if (ring->cq_head == ring->cq_tail) return NULL;
+    asm volatile ("dmb ishld" ::: "memory");
+    return &ring->cq[ring->cq_head % RING_ENTRIES];
+}
+
+void ring_cqe_seen(syscall_ring *ring){
+    asm volatile ("dmb ish" ::: "memory");
+    ring->cq_head++;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Batched syscalls. The process fills submission entries whose opcode is a regular syscall number,
+//then a single ring_enter runs all of them and posts one completion each.
+//Syscalls that block are refused with RING_EINVAL, except sleep, which completes and then ends the batch
+#define RING_ENTRIES 32
+#define RING_EINVAL UINT64_MAX
+
+typedef struct {
+    uint32_t opcode;
+    uint32_t rsvd;
+    uint64_t user_data;
+    uint64_t args[5];
+    uint64_t pad;
+} ring_sqe;
+
+typedef struct {
+    uint64_t user_data;
+    uint64_t result;
+} ring_cqe;
+
+//Heads are advanced by the consumer and tails by the producer: the process owns sq_tail and cq_head, the kernel sq_head and cq_tail
+typedef struct syscall_ring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    ring_sqe sq[RING_ENTRIES];
+    ring_cqe cq[RING_ENTRIES];
+} syscall_ring;
+
+extern syscall_ring* ring_setup();
+extern uint32_t ring_enter();
+
+bool ring_push(syscall_ring *ring, uint32_t opcode, uint64_t user_data, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4);
+ring_cqe* ring_peek_cqe(syscall_ring *ring);
+void ring_cqe_seen(syscall_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
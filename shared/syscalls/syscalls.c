@@ -1,11 +1,15 @@
 #include "syscalls.h"
-#include "std/string.h"
+#include "std/string_builder.h"
 
+//Formats on the stack, only lines longer than the buffer touch the heap
 void printf(const char *fmt, ...){
+    char buf[256];
+    string_builder sb;
+    sb_init_buf(&sb, buf, sizeof(buf), false);
     va_list args;
     va_start(args, fmt);
-    string str = string_format_va(fmt, args);
+    sb_format_va(&sb, fmt, args);
     va_end(args);
-    printl(str.data);
-    free(str.data, str.mem_length);
+    printl(sb.data);
+    sb_free(&sb);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "keypress.h"
 #include "std/string.h"
 #include "net/network_types.h"
+#include "events.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,10 +13,22 @@ extern "C" {
 
 extern void printl(const char *str);
 
-extern uintptr_t malloc(size_t size);
-extern void free(void *ptr, size_t size);
+//Small blocks come from size class lists in the process and never enter the kernel, see std/malloc.c.
+//Kernel code links its own pair that allocates from the current process' heap
+uintptr_t malloc(size_t size);
+void free(void *ptr, size_t size);
+extern uintptr_t malloc_syscall(size_t size);
+extern void free_syscall(void *ptr, size_t size);
+//Page aligned, zeroed memory straight from the kernel. In user processes pages are only committed once touched
+extern void* map_pages(size_t size);
+extern void unmap_pages(void *ptr, size_t size);
 
 extern bool read_key(keypress *kp);
+//Blocking variants, they sleep until data arrives or timeout_msec passes. A timeout of 0 waits forever
+extern bool read_key_wait(keypress *kp, uint64_t timeout_msec);
+//Sleeps until any of the EVENT_ sources in mask is ready or timeout_msec passes (0 waits forever).
+//Returns the ready sources, or EVENT_TIMEOUT. Nothing is consumed, read the sources afterwards
+extern uint32_t wait_events(uint32_t mask, uint64_t timeout_msec);
 
 extern void sleep(uint64_t time);
 extern void halt();
@@ -32,12 +45,16 @@ extern void draw_primitive_rect(gpu_rect *r, color color);
 extern void draw_primitive_char(gpu_point *p, char c, uint32_t scale, uint32_t color);
 extern void draw_primitive_string(string *text, gpu_point *p, uint32_t scale, uint32_t color);
 
-extern uint64_t get_time();
+//Milliseconds since boot, read from the vDSO time page. get_time_syscall is the old trapping path
+uint64_t get_time();
+extern uint64_t get_time_syscall();
+extern uint16_t get_pid();
 
 extern bool bind_port(uint16_t port);
 extern bool unbind_port(uint16_t port);
 extern void send_packet(NetProtocol protocol, uint16_t port, network_connection_ctx *destination, void* payload, uint16_t payload_len);
 extern bool read_packet(sizedptr *ptr);
+extern bool read_packet_wait(sizedptr *ptr, uint64_t timeout_msec);
 
 void printf(const char *fmt, ...);
 
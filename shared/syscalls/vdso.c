@@ -0,0 +1,35 @@
+#include "vdso.h"
+#include "syscalls.h"
+
+#define VDSO_PAGE ((const vdso_time_page*)VDSO_TIME_ADDR)
+
+//Retries if the kernel updated the page while it was being read
+static inline uint64_t vdso_convert(const vdso_time_page *page, const uint64_t *mult_field){
+    uint32_t seq;
+    uint64_t ticks, mult, shift;
+    do {
+        seq = page->seq;
+        asm volatile ("dmb ishld" ::: "memory");
+        mult = *mult_field;
+        shift = page->shift;
+        asm volatile ("isb\nmrs %0, cntvct_el0" : "=r"(ticks) :: "memory");
+        asm volatile ("dmb ishld" ::: "memory");
+    } while ((seq & 1) || seq != page->seq);
+    return (uint64_t)(((__uint128_t)ticks * mult) >> shift);
+}
+
+uint64_t vdso_time_ns(){
+    return vdso_convert(VDSO_PAGE, &VDSO_PAGE->mult_ns);
+}
+
+uint64_t vdso_time_us(){
+    return vdso_convert(VDSO_PAGE, &VDSO_PAGE->mult_us);
+}
+
+uint64_t vdso_time_ms(){
+    return vdso_convert(VDSO_PAGE, &VDSO_PAGE->mult_ms);
+}
+
+uint64_t get_time(){
+    return vdso_time_ms();
+}
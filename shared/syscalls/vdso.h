@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Read-only page the kernel maps into every address space, so time can be read without a syscall
+#define VDSO_TIME_ADDR 0xFFFFFFFFF000ULL
+#define VDSO_TIME_SHIFT 32
+
+//Counter ticks convert to a unit as (ticks * mult) >> shift. seq is odd while the kernel is updating the page
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t shift;
+    uint64_t freq;
+    uint64_t mult_ns;
+    uint64_t mult_us;
+    uint64_t mult_ms;
+} vdso_time_page;
+
+uint64_t vdso_time_ns();
+uint64_t vdso_time_us();
+uint64_t vdso_time_ms();
+
+#ifdef __cplusplus
+}
+#endif
@@ -61,7 +61,7 @@ void mark_dirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
 }
 
 void fb_clear(uint32_t* fb, uint32_t color) {
-    memset(fb, color, stride * max_height);
+    memset32(fb, color, stride * max_height);
     full_redraw = true;
 }
 
@@ -87,6 +87,12 @@ gpu_rect fb_draw_line(uint32_t* fb, uint32_t x0, uint32_t y0, uint32_t x1, uint3
     int sy = (y0 < y1) ? 1 : -1;
     int err = (dx > dy ? dx : -dy) / 2, e2;
 
+    //The loop walks x0 and y0 to the end point, so the bounds come from the start
+    int min_x = (x0 < x1) ? x0 : x1;
+    int min_y = (y0 < y1) ? y0 : y1;
+    int max_x = (x0 > x1) ? x0 : x1;
+    int max_y = (y0 > y1) ? y0 : y1;
+
     for (;;) {
         fb_draw_pixel(fb, x0, y0, color);
         if (x0 == x1 && y0 == y1) break;
@@ -95,11 +101,6 @@ gpu_rect fb_draw_line(uint32_t* fb, uint32_t x0, uint32_t y0, uint32_t x1, uint3
         if (e2 < dy) { err += dx; y0 += sy; }
     }
 
-    int min_x = (x0 < x1) ? x0 : x1;
-    int min_y = (y0 < y1) ? y0 : y1;
-    int max_x = (x0 > x1) ? x0 : x1;
-    int max_y = (y0 > y1) ? y0 : y1;
-
     mark_dirty(min_x,min_y,max_x - min_x + 1,max_y - min_y + 1);
 
     return (gpu_rect) { {min_x, min_y}, {max_x - min_x + 1, max_y - min_y + 1}};
@@ -9,7 +9,9 @@ void proc_func() {
     while (1) {
         keypress kp;
         printf("Print console test %f", (get_time()/1000.f));
-        while (read_key(&kp)){
+        //Redraw once a second unless a key comes in first
+        bool pressed = read_key_wait(&kp, 1000);
+        for (; pressed; pressed = read_key(&kp)){
             if (kp.keys[0] == KEY_ESC)
                 halt();
         }